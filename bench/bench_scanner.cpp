@@ -0,0 +1,96 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "scanner.h"
+#include "simd.h"
+
+using namespace dtoy;
+
+namespace {
+
+// 生成一段接近真实配置脚本的输入：长标识符、数字、字符串常量、缩进和注释
+std::string make_script(std::size_t bytes) {
+  std::string script;
+  script.reserve(bytes + 256);
+  for (std::size_t i = 0; script.size() < bytes; ++i) {
+    script += "    // generated entry " + std::to_string(i) + "\n";
+    script += "    var configuration_entry_" + std::to_string(i) +
+              " = (base_offset_value + " + std::to_string(i * 7919) +
+              ") * 1.5;\n";
+    script += "    print \"a fairly long string constant for entry number " +
+              std::to_string(i) + "\\n\";\n\n";
+  }
+  return script;
+}
+
+// threads == 0 表示串行 scan_tokens()
+double scan_mb_per_second(const std::string &script, simd::Level level,
+                          scanner::Scanner::Mode mode,
+                          std::size_t &token_count, unsigned threads = 0) {
+  double best = 0;
+  for (int round = 0; round < 5; ++round) {
+    scanner::Scanner scanner(script);
+    scanner.set_simd_level(level);
+    scanner.set_mode(mode);
+    auto begin = std::chrono::steady_clock::now();
+    auto tokens = threads == 0 ? scanner.scan_tokens()
+                               : scanner.scan_tokens_parallel(threads);
+    auto end = std::chrono::steady_clock::now();
+    token_count = tokens.size();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    best = std::max(best, script.size() / (1024.0 * 1024.0) / seconds);
+  }
+  return best;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  std::size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 16;
+  std::string script = make_script(megabytes * 1024 * 1024);
+
+  std::cout << "input: " << script.size() / (1024.0 * 1024.0) << " MB, best "
+            << simd::level_name(simd::best_level()) << std::endl;
+  for (simd::Level level :
+       {simd::Level::Scalar, simd::Level::SSE2, simd::Level::AVX2}) {
+    if (static_cast<int>(level) > static_cast<int>(simd::best_level()))
+      continue;
+    std::size_t tokens = 0;
+    double mbps = scan_mb_per_second(script, level,
+                                     scanner::Scanner::Mode::Switch, tokens);
+    std::cout << "scan_tokens [switch, " << simd::level_name(level)
+              << "]: " << mbps << " MB/s, " << tokens << " tokens"
+              << std::endl;
+  }
+  std::size_t tokens = 0;
+  double mbps = scan_mb_per_second(script, simd::best_level(),
+                                   scanner::Scanner::Mode::Table, tokens);
+  std::cout << "scan_tokens [table]: " << mbps << " MB/s, " << tokens
+            << " tokens" << std::endl;
+
+  {
+    scanner::Scanner scanner(script);
+    auto begin = std::chrono::steady_clock::now();
+    auto stream = scanner.scan_token_stream();
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - begin).count();
+    std::cout << "scan_token_stream: "
+              << script.size() / (1024.0 * 1024.0) / seconds << " MB/s, "
+              << static_cast<double>(stream.memory_usage()) / stream.size()
+              << " bytes/token (Token is " << sizeof(token::Token)
+              << " bytes)" << std::endl;
+  }
+
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= cores; threads *= 2) {
+    mbps = scan_mb_per_second(script, simd::best_level(),
+                              scanner::Scanner::Mode::Switch, tokens, threads);
+    std::cout << "scan_tokens_parallel [" << threads << " threads]: " << mbps
+              << " MB/s, " << tokens << " tokens" << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "expr.h"
+#include "stmt.h"
+
+namespace dtoy {
+namespace ast {
+
+// AST 节点的 bump 分配器：节点按顺序切在大块内存里，整棵树随 arena
+// 一起释放，只需要 free 每个块。
+// 需要析构的节点在自己前面放一个记录，arena 析构时按创建的逆序
+// 平铺地调用，不会像 unique_ptr 树那样递归，再深的树也不会爆栈。
+class AstArena {
+public:
+  AstArena() = default;
+  ~AstArena();
+
+  AstArena(const AstArena &) = delete;
+  AstArena &operator=(const AstArena &) = delete;
+
+public:
+  template <typename T, typename... Args> T *make(Args &&...args) {
+    if constexpr (std::is_trivially_destructible_v<T>) {
+      return new (allocate(sizeof(T), alignof(T)))
+          T(std::forward<Args>(args)...);
+    } else {
+      constexpr std::size_t align = alignof(T) > alignof(Finalizer)
+                                        ? alignof(T)
+                                        : alignof(Finalizer);
+      constexpr std::size_t header =
+          (sizeof(Finalizer) + alignof(T) - 1) / alignof(T) * alignof(T);
+      auto *memory = static_cast<std::byte *>(allocate(header + sizeof(T), align));
+      T *node = new (memory + header) T(std::forward<Args>(args)...);
+      // 构造成功之后才登记，构造抛异常时这块内存只是浪费掉
+      finalizers_ = new (memory) Finalizer{
+          node, [](void *object) { static_cast<T *>(object)->~T(); },
+          finalizers_};
+      if (last_finalizer_ == nullptr)
+        last_finalizer_ = finalizers_;
+      return node;
+    }
+  }
+  // 接管 other 的所有块和节点，other 变空；之后继续在自己的当前块里分配。
+  // 并行解析时每个线程一个 arena，最后合并成一个
+  void absorb(AstArena &&other);
+  // 把文本复制进 arena，比如常量折叠出来的字符串；和节点一起释放
+  std::string_view copy_string(std::string_view text);
+  // pointer 是否指向这个 arena 的某个块
+  bool owns(const void *pointer) const;
+
+  std::size_t block_count() const { return blocks_.size(); }
+  // 已经切出去的字节数（含对齐和析构记录）
+  std::size_t bytes_used() const { return used_; }
+
+private:
+  struct Finalizer {
+    void *object;
+    void (*destroy)(void *);
+    Finalizer *next;
+  };
+
+  void *allocate(std::size_t size, std::size_t align) {
+    auto address = reinterpret_cast<std::uintptr_t>(cursor_);
+    std::size_t padding = (align - address % align) % align;
+    if (cursor_ == nullptr ||
+        padding + size > static_cast<std::size_t>(limit_ - cursor_))
+      return grow(size, align);
+    void *result = cursor_ + padding;
+    cursor_ += padding + size;
+    used_ += padding + size;
+    return result;
+  }
+  // 当前块放不下时换一个新块；超过块大小的节点单独占一块
+  void *grow(std::size_t size, std::size_t align);
+
+private:
+  static constexpr std::size_t kBlockSize = 64 * 1024;
+
+  struct Block {
+    std::unique_ptr<std::byte[]> memory;
+    std::size_t size;
+  };
+
+  std::vector<Block> blocks_;
+  std::byte *cursor_ = nullptr;
+  std::byte *limit_ = nullptr;
+  std::size_t used_ = 0;
+  Finalizer *finalizers_ = nullptr;  // 最后创建的在最前面
+  Finalizer *last_finalizer_ = nullptr;  // 链表的尾部，absorb() 时接上
+};
+
+// 一次 parse() 的结果：顶层语句和持有所有节点的 arena。
+// 节点之间用裸指针相连，只在 Program 的生命周期内有效
+class Program {
+public:
+  Program() : arena_(std::make_unique<AstArena>()) {}
+  Program(std::unique_ptr<AstArena> arena,
+          std::vector<stmt::Stmt *> statements,
+          std::vector<std::ptrdiff_t> shifts = {})
+      : arena_(std::move(arena)), statements_(std::move(statements)),
+        shifts_(std::move(shifts)) {}
+
+public:
+  const std::vector<stmt::Stmt *> &statements() const { return statements_; }
+  std::size_t size() const { return statements_.size(); }
+  bool empty() const { return statements_.empty(); }
+  stmt::Stmt *operator[](std::size_t index) const { return statements_[index]; }
+  stmt::Stmt *back() const { return statements_.back(); }
+  auto begin() const { return statements_.begin(); }
+  auto end() const { return statements_.end(); }
+
+  const AstArena &arena() const { return *arena_; }
+  AstArena &arena() { return *arena_; }
+
+  // 增量解析沿用编辑之后的语句时不改节点，只记一个平移：第 index 条
+  // 语句里节点的 offset 加上 shift(index) 才是它在当前 source 里的位置。
+  // 完整解析的 program 没有平移，shifts() 为空
+  std::ptrdiff_t shift(std::size_t index) const {
+    return shifts_.empty() ? 0 : shifts_[index];
+  }
+  const std::vector<std::ptrdiff_t> &shifts() const { return shifts_; }
+
+private:
+  std::unique_ptr<AstArena> arena_;
+  std::vector<stmt::Stmt *> statements_;
+  std::vector<std::ptrdiff_t> shifts_;  // 为空，或者每条语句一个
+};
+
+}  // namespace ast
+}  // namespace dtoy
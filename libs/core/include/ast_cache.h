@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "flat_ast.h"
+#include "source.h"
+
+namespace dtoy {
+namespace ast {
+
+// 脚本旁边的 .dtast 文件：FlatAst 的各个数组原样写出，加载时 mmap 进来，
+// Column 直接指向映射，不需要重新扫描和解析。
+//
+// 文件布局：Header，然后依次是 kinds、ops、operands、offsets、integers、
+// doubles、text、statements、变量名的偏移表和变量名，每段按 8 字节对齐。
+// 数字按写入机器的字节序保存，字节序不同的文件直接当作过期。
+//
+// 缓存按 key() 匹配：源码内容、build_id() 和是否折叠常量，任何一个变了都会
+// 重新解析；文件头里也单独记着 build_id()。加载时只检查各段的边界和值栈的深度，保证解释器不会越界，
+// 不重新计算任何东西。
+class AstCache {
+public:
+  // scanner / parser / 折叠改变了生成的树，或者文件格式变了，就加一
+  static constexpr std::uint32_t kVersion = 1;
+
+  // 构建标识：kVersion、项目版本号、文件布局和运算符编号的哈希。
+  // 换了版本或者改了枚举，即使忘了加 kVersion，旧文件也不会被误读
+  static std::uint64_t build_id();
+
+  static std::uint64_t key(const source::SourceBuffer &source, bool folded);
+  // script.dt -> script.dtast
+  static std::string path_for(const std::string &script);
+
+  // 文件不存在、损坏或者 key 对不上时返回 nullopt。
+  // 返回的树引用 source（字符串字面量）和映射的文件
+  static std::optional<FlatAst>
+  load(const std::string &path,
+       std::shared_ptr<const source::SourceBuffer> source, std::uint64_t key);
+  // 先写临时文件再 rename，并发运行同一个脚本也读不到写了一半的文件。
+  // 写不了（比如目录只读）时返回 false，不抛异常
+  static bool store(const std::string &path, const FlatAst &tree,
+                    std::uint64_t key);
+
+  // 内容哈希，一次处理 8 个字节
+  static std::uint64_t hash(std::string_view bytes, std::uint64_t seed = 0);
+
+private:
+  // 下标都在范围内，值栈不会取空，每条语句结束时栈上正好剩下该有的值
+  static bool validate(const FlatAst &tree);
+};
+
+}  // namespace ast
+}  // namespace dtoy
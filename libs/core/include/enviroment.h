@@ -1,32 +1,45 @@
 
+#include "symbol.h"
 #include "token.h"
-#include <map>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 namespace dtoy {
 namespace enviroment {
+// 变量按扫描时驻留的 symbol id 存放，查找只比较整数
 class Enviroment {
 public:
     using Literal = token::Literal;
-    std::map<std::string, token::Literal> values_;
+    using SymbolId = symbol::SymbolId;
+    std::unordered_map<SymbolId, token::Literal> values_;
     Enviroment() = default;
     ~Enviroment() = default;
-    void define(const std::string& name, const Literal& value) {
+    void define(SymbolId name, const Literal& value) {
         values_[name] = value;
     }
-    Literal get(const std::string& name) {
-        if (values_.find(name) != values_.end()) {
-            return values_[name];
+    Literal get(SymbolId name) {
+        auto it = values_.find(name);
+        if (it != values_.end()) {
+            return it->second;
         }
-        throw std::runtime_error("Undefined variable '" + name + "'.");
+        throw undefined(name);
     }
 
-    Literal assign(const std::string& name, const Literal& value) {
-        if (values_.find(name) != values_.end()) {
-            values_[name] = value;
+    Literal assign(SymbolId name, const Literal& value) {
+        auto it = values_.find(name);
+        if (it != values_.end()) {
+            it->second = value;
             return value;
         }
-        throw std::runtime_error("Undefined variable '" + name + "'.");
+        throw undefined(name);
+    }
+
+private:
+    // 名字只在报错时才从 symbol 表取回
+    static std::runtime_error undefined(SymbolId name) {
+        return std::runtime_error(
+            "Undefined variable '" +
+            std::string(symbol::SymbolTable::global().name(name)) + "'.");
     }
 };
 
@@ -18,54 +18,61 @@ namespace expr {
 
 class Expr;
 
+// 节点由 ast::AstArena 分配，子节点是指向同一个 arena 的裸指针，
+// 不拥有所指向的节点。运算符只存 opcode 和位置，名字只存 symbol 和位置，
+// 常量是 token::Constant：所有节点都可以平凡析构，Expr 一共 32 字节
 class BinaryExpr {
 public:
-  std::unique_ptr<Expr> left;
-  token::Token op;
-  std::unique_ptr<Expr> right;
-  BinaryExpr(std::unique_ptr<Expr> left, token::Token op,
-             std::unique_ptr<Expr> right)
-      : left(std::move(left)), op(op), right(std::move(right)) {}
+  Expr *left;
+  Expr *right;
+  token::Operator op;
+  BinaryExpr(Expr *left, token::Operator op, Expr *right)
+      : left(left), right(right), op(op) {}
 };
 
 class AssignExpr {
 public:
-  token::Token name;
-  std::unique_ptr<Expr> value;
-  AssignExpr(token::Token name, std::unique_ptr<Expr> value)
-      : name(name), value(std::move(value)) {}
+  Expr *value;
+  token::Name name;
+  AssignExpr(token::Name name, Expr *value) : value(value), name(name) {}
 };
 
 
 class UnaryExpr {
 public:
-  token::Token op;
-  std::unique_ptr<Expr> right;
-  UnaryExpr(token::Token op, std::unique_ptr<Expr> right)
-      : op(op), right(std::move(right)) {}
+  Expr *right;
+  token::Operator op;
+  UnaryExpr(token::Operator op, Expr *right) : right(right), op(op) {}
 };
 
 class LiteralExpr {
 public:
-  token::Literal value;
-  LiteralExpr(token::Literal value) : value(value) {}
+  token::Constant value;
+  LiteralExpr(token::Constant value) : value(value) {}
 };
 
 class GroupingExpr {
 public:
-  std::unique_ptr<Expr> expression;
-  GroupingExpr(std::unique_ptr<Expr> expression)
-      : expression(std::move(expression)) {}
+  Expr *expression;
+  GroupingExpr(Expr *expression) : expression(expression) {}
 };
 
 class VariableExpr {
 public:
-  token::Token name;
-  VariableExpr(token::Token name) : name(name) {}
+  token::Name name;
+  VariableExpr(token::Name name) : name(name) {}
+};
+
+// 由 optimizer::share_subexpressions() 插入：一条语句里重复出现的纯表达式，
+// 每处都指向同一个 CachedExpr，解释器在这条语句里只求一次值
+class CachedExpr {
+public:
+  Expr *expression;
+  CachedExpr(Expr *expression) : expression(expression) {}
 };
 
 // 把 GroupingExpr 加入 variant
-using ExprBase = std::variant<BinaryExpr, UnaryExpr, LiteralExpr, GroupingExpr,VariableExpr,AssignExpr>;
+using ExprBase = std::variant<BinaryExpr, UnaryExpr, LiteralExpr, GroupingExpr,VariableExpr,AssignExpr,CachedExpr>;
 
 class Expr : public ExprBase {
 public:
@@ -104,12 +111,13 @@ struct ExprPrinter {
   }
   // 处理 LiteralExpr
   void operator()(const LiteralExpr &expr) const {
-    if (std::holds_alternative<int>(expr.value)) {
-      std::cout << " " << std::get<int>(expr.value);
+    if (std::holds_alternative<std::int64_t>(expr.value)) {
+      std::cout << " " << std::get<std::int64_t>(expr.value);
     } else if (std::holds_alternative<double>(expr.value)) {
       std::cout << " " << std::get<double>(expr.value);
-    } else if (std::holds_alternative<std::string>(expr.value)) {
-      std::cout << " \"" << std::get<std::string>(expr.value) << "\"";
+    } else if (std::holds_alternative<token::StringLiteral>(expr.value)) {
+      std::cout << " \"" << std::get<token::StringLiteral>(expr.value).value()
+                << "\"";
     } else if (std::holds_alternative<bool>(expr.value)) {
       std::cout << " " << (std::get<bool>(expr.value) ? "true" : "false");
     } else {
@@ -122,6 +130,11 @@ struct ExprPrinter {
     std::visit(*this, *expr.value);
     std::cout << ")";
   }
+
+  // 缓存只影响求值次数，打印出来和原来的子树一样
+  void operator()(const CachedExpr &expr) const {
+    std::visit(*this, *expr.expression);
+  }
 };
 
 
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "source.h"
+#include "symbol.h"
+#include "token.h"
+
+namespace dtoy {
+namespace ast {
+
+// 扁平的 AST：所有节点按后序排在几个连续数组里，子节点用 32 位下标。
+// 每个节点固定占 kind(1) + op(1) + operand(4) + offset(4) 字节。
+// 后序排列下最后一个子节点总是紧挨在父节点前面（下标 i - 1），
+// 只有 Binary 需要在 operand 里记左子节点。
+// 整个程序按顺序从头扫到尾就是求值顺序，解释器用一个值栈线性求值。
+// 所有数组都是 POD，可以原样写出去再读回来（见 AstCache）。
+class FlatAst {
+public:
+  enum class Kind : std::uint8_t {
+    // 字面量
+    Nil,
+    True,
+    False,
+    Integer,  // op 为 1 时 operand 就是值，否则是 integers_ 的下标
+    Double,   // operand: doubles_ 的下标
+    Char,     // operand: 字符值
+    String,   // offset / operand: source 里引号之间的原文，op: 是否有转义
+    Text,     // offset / operand: text_ 里的运行时字符串
+    // 表达式
+    Variable,  // operand: symbols_ 的下标
+    Assign,    // operand: symbols_ 的下标；子节点：值
+    Unary,     // op: 运算符；子节点：操作数
+    Binary,    // op: 运算符；operand: 左子节点；右子节点在 i - 1
+    Grouping,  // 子节点：表达式
+    // 语句
+    Expression,  // 子节点：表达式
+    Print,       // 子节点：表达式
+    Var,         // operand: symbols_ 的下标；op: 是否有初始化表达式
+  };
+
+  FlatAst() = default;
+  // 把 program 展开成后序的扁平形式；字符串字面量指向 source 时记成
+  // source 里的位置，否则复制一份。节点的 offset 加上语句的
+  // Program::shift()
+  static FlatAst build(const Program &program,
+                       std::shared_ptr<const source::SourceBuffer> source);
+
+public:
+  std::size_t size() const { return kinds_.size(); }
+  Kind kind(std::uint32_t index) const { return static_cast<Kind>(kinds_[index]); }
+  // Unary / Binary 的运算符
+  token::TokenType op(std::uint32_t index) const {
+    return static_cast<token::TokenType>(ops_[index]);
+  }
+  // 节点对应的 token 在 source 里的偏移，报错时用
+  std::size_t offset(std::uint32_t index) const { return offsets_[index]; }
+  // 最后一个（对单子节点来说是唯一一个）子节点
+  std::uint32_t operand(std::uint32_t index) const { return index - 1; }
+  std::uint32_t left(std::uint32_t index) const { return operands_[index]; }
+  std::uint32_t right(std::uint32_t index) const { return index - 1; }
+  symbol::SymbolId symbol(std::uint32_t index) const {
+    return symbols_[operands_[index]];
+  }
+  bool has_initializer(std::uint32_t index) const { return ops_[index] != 0; }
+  // 字面量节点还原成 token::Literal；String 还原成指向 source 的 StringLiteral
+  token::Literal literal(std::uint32_t index) const;
+  // 以 index 为根的子树是 [subtree_begin(index), index]
+  std::uint32_t subtree_begin(std::uint32_t index) const;
+
+  // 顶层语句的根节点，按程序顺序
+  std::span<const std::uint32_t> statements() const { return statements_.view(); }
+  const std::shared_ptr<const source::SourceBuffer> &source() const {
+    return source_;
+  }
+  // 所有数组实际占用的堆内存字节数（不含 source 和映射的缓存文件）
+  std::size_t memory_usage() const;
+
+private:
+  friend class AstCache;
+
+  // 一列数据。build() 出来的树数据在 owned_ 里；从缓存加载的直接指向
+  // 文件映射，不拷贝也不解码
+  template <typename T> class Column {
+  public:
+    Column() = default;
+    Column(const Column &other) { *this = other; }
+    Column(Column &&) = default;  // vector 移动时缓冲区不变，view_ 仍然有效
+    Column &operator=(const Column &other) {
+      owned_ = other.owned_;
+      view_ = other.borrowed() ? other.view_ : std::span<const T>(owned_);
+      return *this;
+    }
+    Column &operator=(Column &&) = default;
+
+  public:
+    const T &operator[](std::size_t index) const { return view_[index]; }
+    std::size_t size() const { return view_.size(); }
+    const T *data() const { return view_.data(); }
+    std::span<const T> view() const { return view_; }
+    std::size_t capacity_bytes() const { return owned_.capacity() * sizeof(T); }
+
+    void push_back(const T &value) {
+      owned_.push_back(value);
+      view_ = owned_;
+    }
+    void append(const T *values, std::size_t count) {
+      owned_.insert(owned_.end(), values, values + count);
+      view_ = owned_;
+    }
+    void shrink_to_fit() {
+      owned_.shrink_to_fit();
+      view_ = owned_;
+    }
+    // 指向别人的内存，调用方保证它活得比 Column 久
+    void borrow(std::span<const T> values) {
+      owned_.clear();
+      view_ = values;
+    }
+
+  private:
+    bool borrowed() const { return view_.data() != owned_.data(); }
+
+  private:
+    std::vector<T> owned_;
+    std::span<const T> view_;
+  };
+
+  void shrink_to_fit();
+  std::uint32_t push(Kind kind, std::uint8_t op, std::uint32_t operand,
+                     std::size_t offset);
+  std::uint32_t push_literal(const token::Constant &value);
+
+private:
+  std::shared_ptr<const source::SourceBuffer> source_;
+  // 从缓存加载时，所有 Column 都指向这个映射
+  std::shared_ptr<const source::SourceBuffer> image_;
+
+  Column<std::uint8_t> kinds_;
+  Column<std::uint8_t> ops_;
+  Column<std::uint32_t> operands_;
+  Column<std::uint32_t> offsets_;
+
+  Column<std::int64_t> integers_;
+  Column<double> doubles_;
+  Column<char> text_;
+  Column<std::uint32_t> statements_;
+  // 树里的变量名按第一次出现编号，节点只记编号；symbol id 是进程内的，
+  // 不能写进缓存，加载时按名字重新驻留
+  std::vector<symbol::SymbolId> symbols_;
+};
+
+}  // namespace ast
+}  // namespace dtoy
@@ -291,21 +291,28 @@
 
 
 #pragma once
+#include "ast.h"
 #include "enviroment.h"
 #include "expr.h"
+#include "flat_ast.h"
+#include "source.h"
 #include "stmt.h"
 #include "token.h"
+#include <cstdint>
+#include <limits>
 #include <memory>
 #include <stdexcept>
+#include <utility>
 #include <vector>
 #include <iostream> // 需要添加这个头文件
 
 namespace dtoy {
 namespace interpreter {
+// 只带出错运算符的 opcode 和位置，行列号在 report() 里才算
 class RuntimeError : public std::runtime_error {
 public:
-  token::Token token;
-  RuntimeError(token::Token token, const std::string &message)
+  token::Operator token;
+  RuntimeError(token::Operator token, const std::string &message)
       : std::runtime_error(message), token(token) {}
 };
 
@@ -314,31 +321,62 @@ using namespace dtoy::stmt;
 class Interpreter {
 public:
   Interpreter() = default;
+  // source 只用于在运行时错误里给出行列号
+  explicit Interpreter(std::shared_ptr<const source::SourceBuffer> source)
+      : source_(std::move(source)) {}
+  // 报错时用来算行列号；REPL 每次增量解析之后换成新的 source，变量保留
+  void set_source(std::shared_ptr<const source::SourceBuffer> source) {
+    source_ = std::move(source);
+  }
   
   void interpret(const expr::Expr &expression) {
     try {
       Literal result = evaluate(expression);
       std::cout << "Result: " << literalToString(result) << std::endl;
     } catch (const RuntimeError &error) {
-      std::cerr << "Runtime error: " << error.what() << " [line "
-                << error.token.line() << "]" << std::endl;
+      report(error);
     }
   }
 
-  void interpret(const std::vector<std::unique_ptr<Stmt>> &statements) {
+  void interpret(const ast::Program &program) {
+    std::size_t index = 0;
     try {
-      for (const auto &statement_ptr : statements) {
+      for (; index < program.size(); ++index)
+        if (program[index] != nullptr)
+          execute(program[index]);
+    } catch (const RuntimeError &error) {
+      report(error, program.shift(index));
+    }
+  }
+
+  // 扁平 AST 按后序排列，从头扫到尾就是执行顺序
+  void interpret(const ast::FlatAst &tree) {
+    try {
+      run(tree, 0, static_cast<std::uint32_t>(tree.size()));
+    } catch (const RuntimeError &error) {
+      report(error);
+    }
+  }
+
+  // 只求 root 这棵子树
+  token::Literal evaluate(const ast::FlatAst &tree, std::uint32_t root) {
+    return run(tree, tree.subtree_begin(root), root + 1).back();
+  }
+
+  void interpret(const std::vector<Stmt *> &statements) {
+    try {
+      for (const Stmt *statement_ptr : statements) {
         if (!statement_ptr)
           continue;
         execute(statement_ptr);
       }
     } catch (const RuntimeError &error) {
-      std::cerr << "Runtime error: " << error.what() << " [line "
-                << error.token.line() << "]" << std::endl;
+      report(error);
     }
   }
 
-  void execute(const std::unique_ptr<Stmt> &statement) {
+  void execute(const Stmt *statement) {
+    cached_.clear();  // CachedExpr 的值只在一条语句里有效
     auto visitor = [this](auto &&stmt_node) -> void {
       using T = std::decay_t<decltype(stmt_node)>;
       if constexpr (std::is_same_v<T, PrintStmt>) {
@@ -369,6 +407,12 @@ public:
         return this->visitLiteralExpr(expr_node);
       } else if constexpr (std::is_same_v<T, expr::GroupingExpr>) {
         return this->visitGroupingExpr(expr_node);
+      } else if constexpr (std::is_same_v<T, expr::VariableExpr>) {
+        return this->visitVariableExpr(expr_node);
+      } else if constexpr (std::is_same_v<T, expr::AssignExpr>) {
+        return this->visitAssignExpr(expr_node);
+      } else if constexpr (std::is_same_v<T, expr::CachedExpr>) {
+        return this->visitCachedExpr(expr_node);
       }
       // 可以添加其他表达式类型的处理
     };
@@ -394,7 +438,7 @@ public:
     } else {
       value = std::monostate{}; // 或者其他默认值
     }
-    enviroment_.define(stmt.name.lexeme(), value);
+    enviroment_.define(stmt.name.symbol(), value);
 
   }
   
@@ -406,12 +450,21 @@ public:
   Literal visitBinaryExpr(const expr::BinaryExpr &expr) {
     Literal left = evaluate(*expr.left);
     Literal right = evaluate(*expr.right);
+    return binary(expr.op, left, right);
+  }
 
-    switch (expr.op.type()) {
+  // 树形和扁平两种 AST 共用的运算规则；整数溢出报错，不回绕
+  Literal binary(token::Operator op, const Literal &left,
+                 const Literal &right) {
+    switch (op.type()) {
     case token::TokenType::PLUS: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        return std::get<int>(left) + std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        std::int64_t result;
+        if (__builtin_add_overflow(std::get<std::int64_t>(left),
+                                   std::get<std::int64_t>(right), &result))
+          throw RuntimeError(op, "Integer overflow.");
+        return result;
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         return std::get<double>(left) + std::get<double>(right);
@@ -419,91 +472,105 @@ public:
                  std::holds_alternative<std::string>(right)) {
         return std::get<std::string>(left) + std::get<std::string>(right);
       } else {
-        throw RuntimeError(expr.op,
+        throw RuntimeError(op,
                            "Operands must be two numbers or two strings.");
       }
     }
     case token::TokenType::MINUS: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        return std::get<int>(left) - std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        std::int64_t result;
+        if (__builtin_sub_overflow(std::get<std::int64_t>(left),
+                                   std::get<std::int64_t>(right), &result))
+          throw RuntimeError(op, "Integer overflow.");
+        return result;
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         return std::get<double>(left) - std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operands must be numbers.");
+        throw RuntimeError(op, "Operands must be numbers.");
       }
     }
     case token::TokenType::STAR: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        return std::get<int>(left) * std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        std::int64_t result;
+        if (__builtin_mul_overflow(std::get<std::int64_t>(left),
+                                   std::get<std::int64_t>(right), &result))
+          throw RuntimeError(op, "Integer overflow.");
+        return result;
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         return std::get<double>(left) * std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operands must be numbers.");
+        throw RuntimeError(op, "Operands must be numbers.");
       }
     }
     case token::TokenType::SLASH: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        if (std::get<int>(right) == 0) {
-          throw RuntimeError(expr.op, "Division by zero.");
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        if (std::get<std::int64_t>(right) == 0) {
+          throw RuntimeError(op, "Division by zero.");
+        }
+        // INT64_MIN / -1 的商放不下，x86 上直接 SIGFPE
+        if (std::get<std::int64_t>(right) == -1 &&
+            std::get<std::int64_t>(left) ==
+                std::numeric_limits<std::int64_t>::min()) {
+          throw RuntimeError(op, "Integer overflow.");
         }
-        return std::get<int>(left) / std::get<int>(right);
+        return std::get<std::int64_t>(left) / std::get<std::int64_t>(right);
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         if (std::get<double>(right) == 0.0) {
-          throw RuntimeError(expr.op, "Division by zero.");
+          throw RuntimeError(op, "Division by zero.");
         }
         return std::get<double>(left) / std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operands must be numbers.");
+        throw RuntimeError(op, "Operands must be numbers.");
       }
     }
     case token::TokenType::GREATER: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        return std::get<int>(left) > std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        return std::get<std::int64_t>(left) > std::get<std::int64_t>(right);
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         return std::get<double>(left) > std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operands must be numbers.");
+        throw RuntimeError(op, "Operands must be numbers.");
       }
     }
     case token::TokenType::GREATER_EQUAL: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        return std::get<int>(left) >= std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        return std::get<std::int64_t>(left) >= std::get<std::int64_t>(right);
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         return std::get<double>(left) >= std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operands must be numbers.");
+        throw RuntimeError(op, "Operands must be numbers.");
       }
     }
     case token::TokenType::LESS: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        return std::get<int>(left) < std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        return std::get<std::int64_t>(left) < std::get<std::int64_t>(right);
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         return std::get<double>(left) < std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operands must be numbers.");
+        throw RuntimeError(op, "Operands must be numbers.");
       }
     }
     case token::TokenType::LESS_EQUAL: {
-      if (std::holds_alternative<int>(left) &&
-          std::holds_alternative<int>(right)) {
-        return std::get<int>(left) <= std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(left) &&
+          std::holds_alternative<std::int64_t>(right)) {
+        return std::get<std::int64_t>(left) <= std::get<std::int64_t>(right);
       } else if (std::holds_alternative<double>(left) &&
                  std::holds_alternative<double>(right)) {
         return std::get<double>(left) <= std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operands must be numbers.");
+        throw RuntimeError(op, "Operands must be numbers.");
       }
     }
     case token::TokenType::EQUAL_EQUAL: {
@@ -513,55 +580,130 @@ public:
       return left != right;
     }
     default:
-      throw RuntimeError(expr.op, "Unknown binary operator.");
+      throw RuntimeError(op, "Unknown binary operator.");
     }
   }
   
   Literal visitUnaryExpr(const expr::UnaryExpr &expr) {
-    Literal right = evaluate(*expr.right);
-    switch (expr.op.type()) {
+    return unary(expr.op, evaluate(*expr.right));
+  }
+
+  Literal unary(token::Operator op, const Literal &right) {
+    switch (op.type()) {
     case token::TokenType::MINUS: {
-      if (std::holds_alternative<int>(right)) {
-        return -std::get<int>(right);
+      if (std::holds_alternative<std::int64_t>(right)) {
+        std::int64_t result;
+        if (__builtin_sub_overflow(std::int64_t{0}, std::get<std::int64_t>(right),
+                                   &result))
+          throw RuntimeError(op, "Integer overflow.");
+        return result;
       } else if (std::holds_alternative<double>(right)) {
         return -std::get<double>(right);
       } else {
-        throw RuntimeError(expr.op, "Operand must be a number.");
+        throw RuntimeError(op, "Operand must be a number.");
       }
     }
     case token::TokenType::BANG: {
       if (std::holds_alternative<bool>(right)) {
         return !std::get<bool>(right);
       } else {
-        throw RuntimeError(expr.op, "Operand must be a boolean.");
+        throw RuntimeError(op, "Operand must be a boolean.");
       }
     }
     default:
-      throw RuntimeError(expr.op, "Unknown unary operator.");
+      throw RuntimeError(op, "Unknown unary operator.");
     }
   }
   
   Literal visitVariableExpr(const expr::VariableExpr &expr) {
-    return enviroment_.get(expr.name.lexeme());
+    return enviroment_.get(expr.name.symbol());
   }
 
   Literal visitLiteralExpr(const expr::LiteralExpr &expr) { 
-    return expr.value; 
+    // 字符串字面量到这里才解码成运行时的 std::string
+    return token::value_of(expr.value);
   }
   
   Literal visitGroupingExpr(const expr::GroupingExpr &expr) {
     return evaluate(*expr.expression);
   }
 
+  Literal visitCachedExpr(const expr::CachedExpr &expr) {
+    // 一条语句里的 CachedExpr 很少，线性查找就够了
+    for (const auto &[node, value] : cached_)
+      if (node == &expr)
+        return value;
+    Literal value = evaluate(*expr.expression);
+    cached_.emplace_back(&expr, value);
+    return value;
+  }
+
   Literal visitAssignExpr(const expr::AssignExpr &expr) {
     Literal value = evaluate(*expr.value);
-    enviroment_.assign(expr.name.lexeme(), value);
+    enviroment_.assign(expr.name.symbol(), value);
     return value;
   }
 private:
+  // 顺序执行 [first, last) 的节点：子节点的值已经在栈顶，
+  // 父节点从栈上取走它们、压入自己的值；语句会把栈清空
+  std::vector<Literal> run(const ast::FlatAst &tree, std::uint32_t first,
+                           std::uint32_t last) {
+    using Kind = ast::FlatAst::Kind;
+    std::vector<Literal> values;
+    auto pop = [&values] {
+      Literal value = std::move(values.back());
+      values.pop_back();
+      return value;
+    };
+    // 运行时错误只用到运算符的类型和位置
+    auto op_token = [&tree](std::uint32_t index) {
+      return token::Operator(tree.op(index), tree.offset(index));
+    };
+    for (std::uint32_t i = first; i < last; ++i) {
+      switch (tree.kind(i)) {
+      case Kind::Variable:
+        values.push_back(enviroment_.get(tree.symbol(i)));
+        break;
+      case Kind::Assign:
+        // 赋值表达式的值就是栈顶的值，留在栈上
+        enviroment_.assign(tree.symbol(i), values.back());
+        break;
+      case Kind::Unary:
+        values.back() = unary(op_token(i), values.back());
+        break;
+      case Kind::Binary: {
+        Literal right = pop();
+        values.back() = binary(op_token(i), values.back(), right);
+        break;
+      }
+      case Kind::Grouping:
+        break;
+      case Kind::Expression:
+        values.pop_back();
+        break;
+      case Kind::Print:
+        std::cout << literalToString(pop()) << std::endl;
+        break;
+      case Kind::Var:
+        enviroment_.define(tree.symbol(i), tree.has_initializer(i)
+                                               ? pop()
+                                               : Literal{std::monostate{}});
+        break;
+      default: {
+        Literal value = tree.literal(i);
+        if (auto str = std::get_if<token::StringLiteral>(&value))
+          value = str->value();
+        values.push_back(std::move(value));
+        break;
+      }
+      }
+    }
+    return values;
+  }
+
   std::string literalToString(const Literal &value) {
-    if (std::holds_alternative<int>(value)) {
-      return std::to_string(std::get<int>(value));
+    if (std::holds_alternative<std::int64_t>(value)) {
+      return std::to_string(std::get<std::int64_t>(value));
     } else if (std::holds_alternative<double>(value)) {
       // 可以优化double的输出格式
       std::string result = std::to_string(std::get<double>(value));
@@ -583,8 +725,26 @@ private:
     return "unknown";
   }
 
+  // shift：出错语句的 Program::shift()
+  void report(const RuntimeError &error, std::ptrdiff_t shift = 0) const {
+    const std::size_t offset =
+        error.token.offset() + static_cast<std::size_t>(shift);
+    std::cerr << "Runtime error: " << error.what();
+    if (source_ != nullptr) {
+      source::Location location = source_->locate(offset);
+      std::cerr << " [line " << location.line << ", column "
+                << location.column << "]";
+    } else {
+      std::cerr << " [offset " << offset << "]";
+    }
+    std::cerr << std::endl;
+  }
+
 private:
   enviroment::Enviroment enviroment_;
+  std::shared_ptr<const source::SourceBuffer> source_;
+  // 当前语句里已经求过值的 CachedExpr
+  std::vector<std::pair<const expr::CachedExpr *, Literal>> cached_;
 };
 
 } // namespace interpreter
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+
+#include "ast.h"
+#include "expr.h"
+#include "stmt.h"
+
+namespace dtoy {
+namespace optimizer {
+
+struct FoldStats {
+  std::size_t folded = 0;      // 折叠成字面量的运算
+  std::size_t groupings = 0;   // 去掉的括号
+  std::size_t identities = 0;  // 化简掉的恒等运算，如 --x、x * 1
+};
+
+struct ShareStats {
+  std::size_t shared = 0;  // 直接指向已有的相同节点、不再单独分配的子表达式
+  std::size_t cached = 0;  // 在同一条语句里复用前面算好的值的子表达式
+};
+
+// 在 parse() 和 interpret() 之间做常量折叠和代数化简，直接改写 AST。
+// 折叠用的是解释器自己的 Interpreter::binary() / unary()，运行时会出错的
+// 运算（比如除以 0）保持原样，错误照旧在运行时报告。
+// 恒等化简只在操作数的类型确定时做，改写前后的行为（包括报错）完全一样
+// 折叠出来的字符串复制进节点所在的 arena，和 AST 一起释放
+FoldStats fold_constants(ast::Program &program);
+// 单独的一条语句，比如增量解析新加的语句；arena 是它所在 program 的
+FoldStats fold_constants(stmt::Stmt &statement, ast::AstArena &arena);
+// 单独的表达式，比如 Parser::expression() 的结果；expr 可能被换成子节点
+FoldStats fold_constants(expr::Expr *&expr, ast::AstArena &arena);
+
+// 哈希合并（hash-consing）：结构相同的纯表达式（字面量、变量读取、一元和
+// 二元运算）共用一个节点，program 的节点复制到新的 arena，旧的释放掉。
+// 为了让运行时错误的位置保持不变：
+// - 跨语句只合并求值时不会报错的子树，比如字面量、变量读取、类型确定的运算；
+// - 同一条语句里重复出现、中间没有给其中的变量赋值的子树换成同一个
+//   expr::CachedExpr，解释器只在第一次出现的位置求值（和报错）。
+// 合并之后的树是 DAG，不能再交给 Parser::reparse() 做增量解析
+ShareStats share_subexpressions(ast::Program &program);
+
+}  // namespace optimizer
+}  // namespace dtoy
@@ -1,8 +1,17 @@
 #pragma once
+#include "ast.h"
 #include "expr.h"
+#include "scanner.h"
 #include "stmt.h"
 #include "token.h"
+#include "token_stream.h"
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <utility>
 #include <vector>
 
 namespace dtoy {
@@ -12,44 +21,123 @@ using namespace dtoy::stmt;
 
 class Parser {
 public:
-  Parser(std::vector<token::Token> tokens) : tokens_(tokens) {};
-  std::vector<std::unique_ptr<Stmt>> parse() {
-    std::vector<std::unique_ptr<Stmt>> statements;
+  // 借用 tokens，不做拷贝；tokens 需要比 parser 活得更久，
+  // AST 节点不引用它们。source 只用于在报错信息里给出行列号
+  Parser(std::span<const token::Token> tokens,
+         std::shared_ptr<const source::SourceBuffer> source = nullptr)
+      : tokens_(tokens), source_(std::move(source)) {};
+  // 临时的 vector 由 parser 接管
+  Parser(std::vector<token::Token> &&tokens,
+         std::shared_ptr<const source::SourceBuffer> source = nullptr)
+      : owned_(std::move(tokens)), tokens_(owned_), source_(std::move(source)) {};
+  // 流式模式：边解析边从 scanner 拉取 token，只保留一个小窗口
+  explicit Parser(scanner::Scanner &scanner)
+      : scanner_(&scanner), source_(scanner.source()) {};
+  // 直接读取 SoA 的 TokenStream，stream 需要比 parser 活得更久；
+  // check / match 只看类型数组，只有进入 AST 的 token 才会还原成 Token
+  explicit Parser(const token::TokenStream &stream)
+      : stream_(&stream), cursor_(stream), stream_end_(stream.size()),
+        source_(stream.source()) {};
+  // 返回的 Program 接管目前为止分配的所有节点，parser 换一个新的 arena
+  ast::Program parse() {
+    std::vector<Stmt *> statements;
     while (!isAtEnd()) {
       // statements.push_back(statement());
       statements.push_back(declaration());
     }
-    return statements;
+    return ast::Program(
+        std::exchange(arena_, std::make_unique<ast::AstArena>()),
+        std::move(statements));
   };
+  // 并行解析（见 parser_parallel.cpp）：先扫一遍 token 类型，在大括号外的
+  // ';' 之后切段，每段一个线程、一个 arena，最后按顺序拼接、合并 arena。
+  // 结果与 parse() 相同；出错时报告源码里最靠前的那个错误。
+  // 流式模式拿不到后面的 token，退回 parse()。
+  // threads == 0 时使用 std::thread::hardware_concurrency()
+  ast::Program parse_parallel(unsigned threads = 0);
+
+  // 增量解析（见 parser_incremental.cpp）的状态：token、AST 和每条顶层
+  // 语句的 token 范围，下一次编辑在它的基础上重新解析
+  struct Document {
+    token::TokenStream tokens;
+    ast::Program program;
+    // 第 i 条语句的 token 是 [ends[i - 1], ends[i])，第 0 条从 0 开始
+    std::vector<std::size_t> ends;
+    // 已经被替换掉、节点还留在 arena 里的语句数
+    std::size_t garbage = 0;
+  };
+  struct ReparseResult {
+    Document document;
+    // 新 program 的 [first, first + inserted) 替换了旧的
+    // [first, first + removed)，其余语句沿用原来的节点
+    std::size_t first;
+    std::size_t removed;
+    std::size_t inserted;
+    // 沿用的语句里改写了的节点数。编辑之后的语句只在 program 里记一个
+    // 平移（见 Program::shift()），不碰节点，所以总是 0
+    std::size_t rebased = 0;
+  };
+  static Document parse_document(token::TokenStream tokens);
+  // 用 Scanner::relex() 重扫编辑附近的 token，只重新解析碰到这些 token 的
+  // 语句，直到语句边界和旧的对齐。沿用的语句不改节点，编辑之后的
+  // 每条只更新一个平移量。
+  // 出错时抛出 std::runtime_error，previous 保持不变
+  static ReparseResult reparse(Document &&previous,
+                               const scanner::Scanner::Edit &edit);
 
 public:
-  std::unique_ptr<Expr> evaluate();
-  std::unique_ptr<Expr> expression();
-  std::unique_ptr<Stmt> statement();
+  // 单独解析的表达式留在 parser 的 arena 里，和 parser 同生命周期
+  Expr *expression();
+  Stmt *statement();
+  ast::AstArena &arena() { return *arena_; }
 
 private:
-  std::unique_ptr<Expr> assignment();
-  std::unique_ptr<Expr> equality();
-  std::unique_ptr<Expr> comparison();
-  std::unique_ptr<Expr> term();
-  std::unique_ptr<Expr> factor();
-  std::unique_ptr<Expr> unary();
-  std::unique_ptr<Expr> primary();
-  std::unique_ptr<Stmt> printStatement();
-  std::unique_ptr<Stmt> exprStatement();
-  std::unique_ptr<Stmt> declaration();
-  std::unique_ptr<Stmt> varDeclaration();
+  // 只解析 parent 的 token 里 [begin, end) 这一段，节点放在自己的 arena 里
+  Parser(const Parser &parent, std::size_t begin, std::size_t end);
+
+  // 只接受结合力不低于 min_power 的中缀运算符（见 parser.cpp 的 kInfix）
+  Expr *expression(std::uint8_t min_power);
+  Expr *primary();
+  Stmt *printStatement();
+  Stmt *exprStatement();
+  Stmt *declaration();
+  Stmt *varDeclaration();
 private:
   bool match(std::initializer_list<token::TokenType> types);
   bool check(token::TokenType type);
-  token::Token advance();
+  void advance();
   bool isAtEnd();
-  token::Token peek();
-  token::Token previous();
+  token::TokenType peekType();
+  // 返回的引用在下一次 advance() 之前有效（流式模式会移动窗口）；
+  // TokenStream 模式下还原到 scratch_ 里
+  const token::Token &peek();
+  const token::Token &previous();
+  // 建节点只取 previous() 的这两部分，TokenStream 模式下不还原整个 Token
+  token::TokenView previousView();
+  token::Literal previousLiteral();
+  void fill();
+  std::string where(const token::TokenView &token) const;
 
 private:
-  int current_ = 0;
-  std::vector<token::Token> tokens_;
+  // 流式模式下窗口超过这个大小就丢弃已经消费的 token
+  static constexpr std::size_t kStreamWindow = 64;
+
+  std::unique_ptr<ast::AstArena> arena_ = std::make_unique<ast::AstArena>();
+  std::size_t current_ = 0;
+  std::vector<token::Token> owned_;
+  // vector / span 模式下是借用的 token，流式模式下指向 window_
+  std::span<const token::Token> tokens_;
+  std::vector<token::Token> window_;
+  scanner::Scanner *scanner_ = nullptr;
+  const token::TokenStream *stream_ = nullptr;
+  // peek / previous 都在 current_ 附近，不用每次查找所在的片段
+  token::TokenStream::Cursor cursor_;
+  std::size_t stream_end_ = 0;  // TokenStream 模式下只读到这里
+  // Document 的字符串字面量复制进 arena、不指向 source：编辑之后沿用的
+  // 语句只记平移，source 也可能被原地改写
+  bool copy_strings_ = false;
+  std::optional<token::Token> scratch_;
+  std::shared_ptr<const source::SourceBuffer> source_;
 };
 
 } // namespace parser
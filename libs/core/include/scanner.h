@@ -1,9 +1,16 @@
 #pragma once
 
+#include "simd.h"
+#include "source.h"
 #include "token.h"
+#include "token_stream.h"
 // #include <cinttypes>
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace dtoy {
@@ -15,40 +22,147 @@ public:
   friend class ParserTest;
 
 public:
-  Scanner() = default;  // 添加默认构造函数
+  // Switch: 手写 switch 分派；Table: 查表驱动的 DFA（见 scanner_dfa.cpp），
+  // 两者输出的 token 完全一致
+  enum class Mode {
+    Switch,
+    Table,
+  };
+
+public:
+  Scanner() : Scanner(std::string{}) {};  // 添加默认构造函数
   explicit Scanner(std::string sources)
-      : sources_(std::move(sources)), start_(0), current_(0), line_(1) {};
+      : Scanner(source::make_source(std::move(sources))) {};
+  // source 必须是合法的 UTF-8，否则抛出 std::runtime_error；
+  // 超过 token::kMaxSourceBytes 时在校验之前就抛出 std::length_error
+  explicit Scanner(std::shared_ptr<const source::SourceBuffer> source)
+      : source_(std::move(source)), sources_(source_->view()) {
+    token::check_source_size(sources_.size());
+    check_utf8(0, sources_.size());
+  };
   ~Scanner() {};
 
 public:
+  // 单步 scan_token() 扫出来、还没有交给调用方的 token。
+  // scan_tokens() / scan_token_stream() 会把它们连同其余 token 一起移走，
+  // 之后这里是空的；next_token() 不在这里留下 token
   const std::vector<token::Token> &show_tokens() const;
+  // 一次性扫描全部 token，结果移交给调用方（不再拷贝），show_tokens() 清空
   std::vector<token::Token> scan_tokens();
+  // 扫描成紧凑的 TokenStream，不会同时持有整个 Token 数组
+  token::TokenStream scan_token_stream();
+  // 并行扫描（见 scanner_parallel.cpp）：在目标位置附近的换行处切块，每块
+  // 一个线程；切分点落在跨行字符串里时补扫，结果与 scan_tokens() 逐个
+  // token 一致。
+  // threads == 0 时使用 std::thread::hardware_concurrency()
+  std::vector<token::Token> scan_tokens_parallel(unsigned threads = 0);
+
+  // 一次编辑：把 [offset, offset + removed) 替换成 inserted
+  struct Edit {
+    std::size_t offset;
+    std::size_t removed;
+    std::string inserted;
+  };
+  struct RelexResult {
+    token::TokenStream tokens;  // 新 source 的完整 token 序列
+    // tokens 里 [first, first + relexed) 是重新扫描出来的，其余沿用旧的
+    std::size_t first;
+    std::size_t relexed;
+  };
+  // 增量重扫（见 scanner_incremental.cpp）：只从编辑位置附近重新扫描，
+  // 直到和旧 token 序列重新对齐；前后没变的 token 和 previous 共用，
+  // 之后的只记一个 offset 平移。
+  // 结果与对编辑后的文本完整 scan_token_stream() 相同
+  static RelexResult relex(const token::TokenStream &previous,
+                           const Edit &edit, Mode mode = Mode::Switch);
+  // 同上，text 是调用方已经按 edit 改好的新 source（比如
+  // SourceBuffer::Rewrite 原地改写的）；只读 previous 的位置和类型，
+  // 不读它的文本
+  static RelexResult relex(const token::TokenStream &previous,
+                           const Edit &edit,
+                           std::shared_ptr<const source::SourceBuffer> text,
+                           Mode mode = Mode::Switch);
+  // 按需拉取下一个 token，到结尾后一直返回 EOF_；
+  // 不会在 scanner 里累积 token，内存占用与脚本大小无关
+  token::Token next_token();
+  // 指定批量字符分类的实现（默认使用 CPU 支持的最高级别）
+  void set_simd_level(simd::Level level) { kernels_ = &simd::kernels(level); }
+  simd::Level simd_level() const { return kernels_->level; }
+  void set_mode(Mode mode) { mode_ = mode; }
+  Mode mode() const { return mode_; }
+  // token 的 lexeme 指向这个 buffer，持有它可以让 token 比 scanner 活得更久
+  const std::shared_ptr<const source::SourceBuffer> &source() const {
+    return source_;
+  }
 
 private:
-  inline bool is_at_end() const;
-  inline char advance();
+  // 只扫描 source 的 [begin, end) 一段，不做 UTF-8 校验；
+  // 并行扫描的每个块和增量重扫用它
+  Scanner(std::shared_ptr<const source::SourceBuffer> source,
+          std::size_t begin, std::size_t end)
+      : source_(std::move(source)),
+        sources_(source_->slice(begin, end - begin)), base_(begin) {};
+
+  enum class NumberKind {
+    Integer,
+    Float,
+    Hex,     // 0x1F
+    Binary,  // 0b1010
+  };
+
+  bool is_at_end() const { return current_ >= sources_.length(); }
+  char advance() {
+    if (is_at_end())
+      return '\0';
+    return sources_[current_++];
+  }
   void skip_whitespace();
+  // source 的 [begin, end) 不是合法 UTF-8 时抛出 std::runtime_error
+  void check_utf8(std::size_t begin, std::size_t end) const;
+  token::Token eof_token() const;
   void add_token(token::TokenType type);
-  void add_token(token::TokenType type, std::string lexeme);
   void add_token(token::TokenType type, token::Literal literal);
-  void add_token(token::TokenType type, std::string lexeme,
-                 token::Literal literal);
+  std::string_view current_lexeme() const;
+  // sources_ 里的位置换成整个 source 里的字节偏移
+  std::size_t offset_of(std::size_t position) const {
+    return base_ + position;
+  }
 
-  std::pair<char, char> process_escape_sequence(char escape_char);
+  char process_escape_sequence(char escape_char);
   char peek() const;
   char peek_next() const;
   bool match(char expected);
   void scan_token();
+  void scan_remaining();
+  void scan_token_table();
   void string();
+  void character();
   void number();
   void identifierAndKeywords();
+  void add_identifier();
+  void digit_run(int base);
+  void add_number(NumberKind kind);
+  void line_comment();
+  // 用批量分类函数把 current_ 推进到 [current_, end) 内它返回的位置
+  template <typename Kernel, typename... Args>
+  void skip_with(Kernel kernel, Args &...args) {
+    const char *base = sources_.data();
+    current_ = static_cast<std::size_t>(
+        kernel(base + current_, base + sources_.size(), args...) - base);
+  }
 
 private:
-  std::string sources_;
+  std::shared_ptr<const source::SourceBuffer> source_;
+  std::string_view sources_;
+  std::size_t base_ = 0;  // sources_ 在 source_ 里的起点
   std::vector<token::Token> tokens_;
-  int current_;
-  int start_;
-  int line_;
+  const simd::Kernels *kernels_ = &simd::kernels();
+  Mode mode_ = Mode::Switch;
+  // 位置都是 size_t，超过 2 GB 的脚本也能扫描
+  std::size_t start_ = 0;
+  std::size_t current_ = 0;
+  // 有字符串一直到 sources_ 结尾都没有闭合
+  bool string_cut_ = false;
 };
 }  // namespace scanner
 }  // namespace dtoy
\ No newline at end of file
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace dtoy {
+namespace simd {
+
+// 扫描器热点循环的批量字符分类。
+// 每个函数都从 p 开始向后找，返回第一个不属于该类的位置（最多到 end）。
+// 分类按字节定义，不依赖 locale：
+//   whitespace: ' ' \t \n \v \f \r
+//   identifier: [A-Za-z0-9_] 以及所有 >= 0x80 的字节（UTF-8 多字节字符，
+//               source 在扫描前已经校验过）
+//   digit:      [0-9]
+//   hex digit:  [0-9A-Fa-f]
+enum CharClass : std::uint8_t {
+  kSpace = 1 << 0,
+  kIdentifier = 1 << 1,
+  kDigit = 1 << 2,
+  kAlpha = 1 << 3,  // [A-Za-z_] 和非 ASCII，可以作为标识符开头
+  kHexDigit = 1 << 4,
+};
+
+constexpr std::array<std::uint8_t, 256> make_char_class_table() {
+  std::array<std::uint8_t, 256> table{};
+  for (int c = '\t'; c <= '\r'; ++c)
+    table[c] |= kSpace;
+  table[' '] |= kSpace;
+  for (int c = 'a'; c <= 'z'; ++c)
+    table[c] |= kIdentifier | kAlpha;
+  for (int c = 'A'; c <= 'Z'; ++c)
+    table[c] |= kIdentifier | kAlpha;
+  for (int c = '0'; c <= '9'; ++c)
+    table[c] |= kIdentifier | kDigit | kHexDigit;
+  for (int c = 'a'; c <= 'f'; ++c)
+    table[c] |= kHexDigit;
+  for (int c = 'A'; c <= 'F'; ++c)
+    table[c] |= kHexDigit;
+  table['_'] |= kIdentifier | kAlpha;
+  for (int c = 0x80; c < 0x100; ++c)
+    table[c] |= kIdentifier | kAlpha;
+  return table;
+}
+inline constexpr auto kCharClassTable = make_char_class_table();
+
+constexpr bool has_class(char c, std::uint8_t cls) {
+  return kCharClassTable[static_cast<unsigned char>(c)] & cls;
+}
+constexpr bool is_space(char c) { return has_class(c, kSpace); }
+constexpr bool is_identifier(char c) { return has_class(c, kIdentifier); }
+constexpr bool is_digit(char c) { return has_class(c, kDigit); }
+constexpr bool is_alpha(char c) { return has_class(c, kAlpha); }
+constexpr bool is_hex_digit(char c) { return has_class(c, kHexDigit); }
+
+enum class Level {
+  Scalar,
+  SSE2,
+  AVX2,
+};
+
+struct Kernels {
+  Level level;
+  const char *(*skip_whitespace)(const char *p, const char *end);
+  const char *(*skip_identifier)(const char *p, const char *end);
+  const char *(*skip_digits)(const char *p, const char *end);
+  // 字符串字面量体：找到第一个 '"' 或 '\\'
+  const char *(*find_string_special)(const char *p, const char *end);
+  // 行注释、换行表：找到第一个 '\n'
+  const char *(*find_newline)(const char *p, const char *end);
+  // 返回第一个不合法的 UTF-8 字节的位置，全部合法时返回 end
+  const char *(*validate_utf8)(const char *p, const char *end);
+};
+
+// 当前 CPU 支持的最高级别（运行时检测，结果会缓存）
+Level best_level();
+// 取某个级别的实现；CPU 不支持时退回到 best_level()
+const Kernels &kernels(Level level);
+inline const Kernels &kernels() { return kernels(best_level()); }
+
+const char *level_name(Level level);
+
+}  // namespace simd
+}  // namespace dtoy
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dtoy {
+namespace source {
+
+// 行号和列号都从 1 开始，列按 UTF-8 字符计
+struct Location {
+  int line;
+  int column;
+};
+
+// 持有脚本源码文本。token 的 lexeme 都是指向这里的 string_view,
+// 所以 buffer 必须比由它扫描出来的 token / AST 活得更久。
+// 文本要么是自己持有的 std::string，要么是只读映射的文件（见 open()）。
+class SourceBuffer {
+  struct Growable;
+
+public:
+  SourceBuffer() : data_(text_.data()) {}
+  explicit SourceBuffer(std::string text)
+      : text_(std::move(text)), data_(text_.data()), size_(text_.size()) {}
+  ~SourceBuffer();
+
+  SourceBuffer(const SourceBuffer &) = delete;
+  SourceBuffer &operator=(const SourceBuffer &) = delete;
+
+  // 读取脚本文件：普通文件 mmap 只读映射，不拷贝到堆上；
+  // 管道、字符设备等不能映射的，退回到一次性读进内存。
+  // 打不开或读取失败时抛出 std::runtime_error
+  static std::shared_ptr<const SourceBuffer> open(const std::string &path);
+  // 把 base 的 [offset, offset + removed) 换成 inserted 得到的新 buffer，
+  // base 本身不变。在末尾追加时新 buffer 和 base 共用一块留了余量的内存，
+  // 只拷贝追加的文本（余量用完时整体翻倍，均摊下来和追加的长度成正比）；
+  // 其他位置的编辑要保住 base，拷贝一次全文，不需要保住时用 Rewrite
+  static std::shared_ptr<const SourceBuffer>
+  splice(const std::shared_ptr<const SourceBuffer> &base, std::size_t offset,
+         std::size_t removed, std::string_view inserted);
+
+  // 不再需要旧文本时的 splice()：base 只剩调用方这一份引用、文本也没有
+  // 和别的 buffer 共用时，直接在 base 的内存里改写，编辑点之前的字节不动，
+  // 只挪动后缀，开销和后缀的长度成正比（余量不够时照样拷贝全文，
+  // 新分配的内存留一倍余量）。原地改写期间 base 读到的是新文本，
+  // 调用方不能再通过 base 读编辑点之后的内容；没有 commit() 就析构时
+  // 把文本改回去，base 恢复原样；所以 commit() 之前也不能再编辑 result()。
+  // 编辑范围超出 base 时抛出 std::out_of_range
+  class Rewrite {
+  public:
+    Rewrite(const std::shared_ptr<const SourceBuffer> &base,
+            std::size_t offset, std::size_t removed, std::string_view inserted);
+    ~Rewrite();
+
+    Rewrite(const Rewrite &) = delete;
+    Rewrite &operator=(const Rewrite &) = delete;
+
+    // 编辑之后的 buffer
+    const std::shared_ptr<const SourceBuffer> &result() const {
+      return result_;
+    }
+    bool in_place() const { return storage_ != nullptr; }
+    void commit() { storage_ = nullptr; }
+
+  private:
+    std::shared_ptr<const SourceBuffer> result_;
+    // 原地改写、还没有 commit() 时是被改写的文本
+    Growable *storage_ = nullptr;
+    std::size_t offset_ = 0;
+    std::size_t inserted_ = 0;
+    std::string removed_;  // 被换掉的原文，还原时写回去
+  };
+
+public:
+  std::string_view view() const { return std::string_view(data_, size_); }
+  const char *data() const { return data_; }
+  std::size_t size() const { return size_; }
+  char operator[](std::size_t index) const { return data_[index]; }
+  // 文本是否直接来自文件映射
+  bool mapped() const { return mapping_ != nullptr; }
+
+  // [offset, offset + length) 的切片，不做拷贝
+  std::string_view slice(std::size_t offset, std::size_t length) const {
+    return view().substr(offset, length);
+  }
+
+  bool contains(std::string_view text) const {
+    return text.data() >= data_ && text.data() + text.size() <= data_ + size_;
+  }
+  // text 必须是这个 buffer 的切片
+  std::size_t offset_of(std::string_view text) const {
+    return static_cast<std::size_t>(text.data() - data_);
+  }
+
+  // 行号只在报错时才需要：第一次调用时用 SIMD 扫一遍建立换行表，
+  // 之后二分查找
+  Location locate(std::size_t offset) const;
+  // 所有 '\n' 的偏移，升序
+  const std::vector<std::size_t> &newline_offsets() const;
+
+private:
+  // 可以在末尾原地追加的文本：已有的 buffer 只引用它的前缀，
+  // 追加只往后写，不会移动已有的字节
+  struct Growable {
+    std::mutex mutex;
+    std::string text;
+  };
+  SourceBuffer(std::shared_ptr<Growable> growable, std::size_t size)
+      : growable_(std::move(growable)), data_(growable_->text.data()),
+        size_(size) {}
+
+private:
+  std::string text_;
+  std::shared_ptr<Growable> growable_;
+  const char *data_;
+  std::size_t size_ = 0;
+  void *mapping_ = nullptr;  // mmap 的起点，munmap 时用
+  mutable std::once_flag newlines_once_;
+  mutable std::vector<std::size_t> newlines_;
+};
+
+inline std::shared_ptr<const SourceBuffer> make_source(std::string text) {
+  return std::make_shared<const SourceBuffer>(std::move(text));
+}
+
+}  // namespace source
+}  // namespace dtoy
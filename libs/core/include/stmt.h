@@ -5,29 +5,29 @@
 namespace dtoy {
 namespace stmt {
 class Stmt;
+// 和表达式一样，语句节点和子节点都在 ast::AstArena 里
 class ExpressionStmt {
 public:
-    std::unique_ptr<expr::Expr> expression;
-    ExpressionStmt(std::unique_ptr<expr::Expr> expr) : expression(std::move(expr)) {}
+    expr::Expr *expression;
+    ExpressionStmt(expr::Expr *expr) : expression(expr) {}
 };
 class PrintStmt {
 public:
-    std::unique_ptr<expr::Expr> expression;
-    PrintStmt(std::unique_ptr<expr::Expr> expr) : expression(std::move(expr)) {}
+    expr::Expr *expression;
+    PrintStmt(expr::Expr *expr) : expression(expr) {}
 };
 class VarStmt {
 public:
-    token::Token name;
-    std::unique_ptr<expr::Expr> initializer;
-    VarStmt(token::Token name, std::unique_ptr<expr::Expr> init)
-        : name(name), initializer(std::move(init)) {}
+    token::Name name;
+    expr::Expr *initializer;  // 没有初始化表达式时为 nullptr
+    VarStmt(token::Name name, expr::Expr *init)
+        : name(name), initializer(init) {}
 };
 
 class BlockStmt {
 public:
-    std::vector<std::unique_ptr<Stmt>> statements;
-    BlockStmt(std::vector<std::unique_ptr<Stmt>> stmts)
-        : statements(std::move(stmts)) {}
+    std::vector<Stmt *> statements;
+    BlockStmt(std::vector<Stmt *> stmts) : statements(std::move(stmts)) {}
 };
 
 
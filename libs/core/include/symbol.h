@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace dtoy {
+namespace symbol {
+
+// 标识符在扫描时只驻留一次，之后 token / AST / 环境里都用 32 位 id 比较
+using SymbolId = std::uint32_t;
+inline constexpr SymbolId kNoSymbol = std::numeric_limits<SymbolId>::max();
+
+// 线程安全：查找走共享锁，只有第一次出现的名字才拿独占锁
+class SymbolTable {
+public:
+  SymbolTable() = default;
+  SymbolTable(const SymbolTable &) = delete;
+  SymbolTable &operator=(const SymbolTable &) = delete;
+
+public:
+  // 同一个名字总是返回同一个 id；id 从 0 开始连续分配
+  SymbolId intern(std::string_view name);
+  // 只查不插入，名字从未出现过时返回 kNoSymbol
+  SymbolId find(std::string_view name) const;
+  // 返回的 view 在 table 的整个生命周期内有效
+  std::string_view name(SymbolId id) const;
+  std::size_t size() const;
+
+  // scanner、parser 和 interpreter 共用的全局表
+  static SymbolTable &global();
+
+private:
+  mutable std::shared_mutex mutex_;
+  // deque 扩容时不移动已有元素，index_ 的 key 可以直接指向这里
+  std::deque<std::string> names_;
+  std::unordered_map<std::string_view, SymbolId> index_;
+};
+
+}  // namespace symbol
+}  // namespace dtoy
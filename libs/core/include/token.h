@@ -1,14 +1,20 @@
 #pragma once
 
 #include <cstddef>
-#include <map>
+#include <cstdint>
+#include <limits>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <variant>
+
+#include "symbol.h"
 namespace dtoy {
 namespace token {
 
-enum class TokenType {
+// 一个字节，AST 节点里直接拿它当运算符的 opcode
+enum class TokenType : std::uint8_t {
   // Single-character tokens.
   LEFT_PAREN,
   RIGHT_PAREN,
@@ -59,44 +65,190 @@ enum class TokenType {
   EOF_,
 };
 
-using Literal = std::variant<std::string,bool, char, int, double, std::nullptr_t,std::monostate>;
+inline constexpr std::size_t kTokenTypeCount =
+    static_cast<std::size_t>(TokenType::EOF_) + 1;
+
+// 转义字符 '\n' 等对应的字符；不认识的转义原样返回
+char unescape(char escape_char);
+
+[[noreturn]] void throw_offset_too_large();
+
+// AST 节点里的位置和字符串长度只有 32 位，超过 4 GB 的和
+// TokenStream::push_back 一样抛出 std::length_error，不截断
+inline std::uint32_t node_offset(std::size_t offset) {
+  if (offset > std::numeric_limits<std::uint32_t>::max())
+    throw_offset_too_large();
+  return static_cast<std::uint32_t>(offset);
+}
+
+// 能解析的 source 最多这么大：AST 节点和 TokenStream 都只存 32 位位置
+inline constexpr std::size_t kMaxSourceBytes =
+    std::numeric_limits<std::uint32_t>::max();
+// 超过 kMaxSourceBytes 时抛出 std::length_error，报出实际大小。
+// Scanner 构造时就检查，不用扫完 4 GB 才在中途失败
+void check_source_size(std::size_t size);
+
+// 字符串字面量的值：扫描时只记录引号之间的原文（指向 source 的视图）
+// 和是否出现过反斜杠，真正用到值时才解码
+// 长度存成 32 位，整个对象 16 字节
+class StringLiteral {
+public:
+  StringLiteral() = default;
+  StringLiteral(std::string_view raw, bool escaped)
+      : data_(raw.data()), size_(node_offset(raw.size())),
+        escaped_(escaped) {}
+
+  std::string_view raw() const { return {data_, size_}; }
+  bool escaped() const { return escaped_; }
+  // 没有转义时就是 raw() 的拷贝
+  std::string value() const;
+
+  friend bool operator==(const StringLiteral &a, const StringLiteral &b) {
+    if (!a.escaped_ && !b.escaped_)
+      return a.raw() == b.raw();
+    return a.value() == b.value();
+  }
 
+private:
+  const char *data_ = nullptr;
+  std::uint32_t size_ = 0;
+  bool escaped_ = false;
+};
+
+// 整数字面量是 64 位的，超出 int64 范围的在扫描时提升为 double。
+// STRING token 的字面量是 StringLiteral；std::string 是运行时的字符串值
+using Literal = std::variant<std::string,bool, char, std::int64_t, double, std::nullptr_t,std::monostate, StringLiteral>;
+
+// AST 里的常量：Literal 去掉 std::string，可以平凡析构，24 字节
+using Constant = std::variant<bool, char, std::int64_t, double, std::nullptr_t,
+                              std::monostate, StringLiteral>;
+// std::string 复制进 strings（比如 ast::AstArena::copy_string()），换成指向
+// 这份拷贝的 StringLiteral，文本和 strings 同生共死
+template <typename Strings>
+Constant constant_of(const Literal &value, Strings &strings) {
+  return std::visit(
+      [&strings](const auto &literal) -> Constant {
+        using T = std::decay_t<decltype(literal)>;
+        if constexpr (std::is_same_v<T, std::string>)
+          return StringLiteral(strings.copy_string(literal), false);
+        else
+          return literal;
+      },
+      value);
+}
+// 运行时的值：字符串字面量在这里才解码成 std::string
+Literal value_of(const Constant &value);
+
+// lexeme 是指向 source::SourceBuffer 的视图，Token 本身不拥有文本。
+// 位置只记录 lexeme 在 source 里的字节偏移，行号和列号在报错时
+// 用 SourceBuffer::locate() 算出来
 class Token {
 public:
-  Token(TokenType type, std ::string lexeme, Literal literal, int line)
-      : type_(type), lexeme_(lexeme), literal_(literal), line_(line) {};
-  Token(TokenType type, std::string lexeme, int line)
-      : type_(type), lexeme_(lexeme), literal_(std::monostate{}), line_(line) {
-        };
+  Token(TokenType type, std::string_view lexeme, Literal literal,
+        std::size_t offset)
+      : type_(type), literal_(std::move(literal)), lexeme_(lexeme),
+        offset_(offset) {};
+  Token(TokenType type, std::string_view lexeme, std::size_t offset)
+      : type_(type), literal_(std::monostate{}), lexeme_(lexeme),
+        offset_(offset) {};
+  // IDENTIFIER token，带上扫描时驻留得到的 symbol id
+  static Token identifier(std::string_view lexeme, symbol::SymbolId symbol,
+                          std::size_t offset) {
+    Token token(TokenType::IDENTIFIER, lexeme, offset);
+    token.symbol_ = symbol;
+    return token;
+  }
   TokenType type() const {
     return type_;
   }
-  Literal literal() const {
+  const Literal &literal() const {
     return literal_;
   }
-  std::string lexeme() const {
+  std::string_view lexeme() const {
     return lexeme_;
   }
-  int line() const {
-    return line_;
+  std::size_t offset() const {
+    return offset_;
   }
-  std::string type_name() const {
-    return type_names[type_];
+  // 只有 IDENTIFIER 有 id，其他 token 是 symbol::kNoSymbol
+  symbol::SymbolId symbol() const {
+    return symbol_;
   }
+  std::string_view type_name() const;
 
 public:
   std::string to_string() const;
   std::string literalToString() const;
-  static std::pair<bool,TokenType>  isKeyword(const std::string& str);
+  static std::pair<bool,TokenType>  isKeyword(std::string_view str);
 
 
 private:
   TokenType type_;
+  symbol::SymbolId symbol_ = symbol::kNoSymbol;  // 和 type_ 共用 8 字节
   Literal literal_;
-  std::string lexeme_;
-  int line_;
-  static std::map<TokenType, std::string> type_names;
-  static std::map<std::string, TokenType> keywords;
+  std::string_view lexeme_;
+  std::size_t offset_;
+};
+
+// AST 节点里保存的 token：只有类型、lexeme、位置和 symbol id，不带字面量。
+// 运算符和名字只用得到这些，比整个 Token 小一半多
+class TokenView {
+public:
+  TokenView(TokenType type, std::string_view lexeme, std::size_t offset,
+            symbol::SymbolId symbol = symbol::kNoSymbol)
+      : type_(type), symbol_(symbol), lexeme_(lexeme), offset_(offset) {}
+  TokenView(const Token &token)
+      : TokenView(token.type(), token.lexeme(), token.offset(),
+                  token.symbol()) {}
+
+  TokenType type() const { return type_; }
+  std::string_view lexeme() const { return lexeme_; }
+  std::size_t offset() const { return offset_; }
+  symbol::SymbolId symbol() const { return symbol_; }
+
+private:
+  TokenType type_;
+  symbol::SymbolId symbol_;
+  std::string_view lexeme_;
+  std::size_t offset_;
+};
+
+// 运算符的写法，比如 PLUS 是 "+"；不是运算符的返回空串
+std::string_view spelling(TokenType type);
+
+// AST 节点里的运算符：opcode 加上 32 位的 source 位置，8 字节。
+// 行列号在报错时才由位置算出来
+class Operator {
+public:
+  Operator(TokenType type, std::size_t offset)
+      : offset_(node_offset(offset)), type_(type) {}
+  Operator(const TokenView &token) : Operator(token.type(), token.offset()) {}
+
+  TokenType type() const { return type_; }
+  std::size_t offset() const { return offset_; }
+  std::string_view lexeme() const { return spelling(type_); }
+
+private:
+  std::uint32_t offset_;
+  TokenType type_;
+};
+
+// AST 节点里的名字：symbol id 加上 32 位的 source 位置，8 字节。
+// 文本要时从 symbol 表取回
+class Name {
+public:
+  Name(symbol::SymbolId symbol, std::size_t offset)
+      : symbol_(symbol), offset_(node_offset(offset)) {}
+  Name(const TokenView &token) : Name(token.symbol(), token.offset()) {}
+
+  symbol::SymbolId symbol() const { return symbol_; }
+  std::size_t offset() const { return offset_; }
+  // 没有驻留过的名字（symbol::kNoSymbol）返回空串
+  std::string_view lexeme() const;
+
+private:
+  symbol::SymbolId symbol_;
+  std::uint32_t offset_;
 };
 
 }  // namespace token
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "source.h"
+#include "symbol.h"
+#include "token.h"
+
+namespace dtoy {
+namespace token {
+
+// struct-of-arrays 形式的 token 序列。
+// 每个 token 固定占 type(1) + offset(4) + length(4) 字节；
+// 字面量和标识符的 symbol id 放在按 token 下标递增的稀疏表里，
+// 只有真正带这些信息的 token 才占空间。行号由 offset 经
+// SourceBuffer::locate() 算出，不单独保存。
+// TRUE / FALSE / NIL 的字面量由类型推出，不进稀疏表。
+// offset 和 length 只有 32 位，超过 4 GB 的 source 在 push_back 时抛出
+// std::length_error；AST 节点也一样，这种脚本在解析之前就由
+// check_source_size() 拒绝。
+//
+// 数组按 kChunkTokens 个 token 分块，写满的块只读、可以被多个 stream
+// 共用。stream 是一串片段，每段是某个块的一个区间加上一个 offset 平移：
+// append() 只复制片段，不复制 token，增量重扫接回编辑前后没变的 token
+// 时只花片段数的时间。片段太多时 compact() 重新整理成连续的块。
+// 拷贝出来的 stream 和原来的共用块，不要在一个线程里追加的同时在
+// 另一个线程里读它的拷贝。
+class TokenStream {
+  struct Piece;
+
+public:
+  static constexpr std::size_t kChunkTokens = 4096;
+
+  // 顺序读取用的游标：记住上一次所在的片段，下标还在这一段或者落到下一段
+  // 时不用二分查找。parser 的 peek / advance 和增量重扫都只在附近移动，
+  // 重扫拼接过的 stream 也和新扫描的一样是 O(1)。
+  // 游标只读 stream，每个读者各用一个，不在线程之间共用
+  class Cursor {
+  public:
+    Cursor() = default;
+    explicit Cursor(const TokenStream &stream) : stream_(&stream) {}
+
+    TokenType type(std::size_t index) {
+      return stream_->type(find(index), index);
+    }
+    std::size_t offset(std::size_t index) {
+      return stream_->offset(find(index), index);
+    }
+    std::size_t length(std::size_t index) {
+      return stream_->length(find(index), index);
+    }
+    std::string_view lexeme(std::size_t index) {
+      const Piece &piece = find(index);
+      return stream_->source_->slice(stream_->offset(piece, index),
+                                     stream_->length(piece, index));
+    }
+    Literal literal(std::size_t index) {
+      return stream_->literal(find(index), index);
+    }
+    symbol::SymbolId symbol(std::size_t index) {
+      return stream_->symbol(find(index), index);
+    }
+    Token at(std::size_t index) { return stream_->at(find(index), index); }
+
+  private:
+    const Piece &find(std::size_t index);
+
+  private:
+    const TokenStream *stream_ = nullptr;
+    std::size_t piece_ = 0;
+  };
+
+  TokenStream() = default;
+  explicit TokenStream(std::shared_ptr<const source::SourceBuffer> source)
+      : source_(std::move(source)) {}
+
+public:
+  // token 的 lexeme 必须指向 source() 里的文本
+  void push_back(const Token &token);
+  // 追加 other 的 [first, last) 段，offset 整体平移 shift；
+  // 增量重扫用它把编辑前后没有变化的 token 接回来。
+  // 和 other 共用块，不复制 token，other 的 source 可以先于这个 stream 释放
+  void append(const TokenStream &other, std::size_t first, std::size_t last,
+              std::ptrdiff_t shift = 0);
+  void reserve(std::size_t count);
+  // 扫描结束后释放各数组多余的容量
+  void shrink_to_fit();
+  // 所有 token 复制进新的、连续排列的块
+  void compact();
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  // 片段数：新扫描的 stream 每 kChunkTokens 个 token 一段
+  std::size_t piece_count() const { return pieces_.size(); }
+
+  // 按下标随机读取；拼接过的 stream 每次要二分查找片段，
+  // 顺序读的时候用 Cursor
+  TokenType type(std::size_t index) const { return type(find(index), index); }
+  std::string_view lexeme(std::size_t index) const {
+    return source_->slice(offset(index), length(index));
+  }
+  std::size_t offset(std::size_t index) const {
+    return offset(find(index), index);
+  }
+  std::size_t length(std::size_t index) const {
+    return length(find(index), index);
+  }
+  // 字符串字面量按这个 stream 的 source 重新定位，所以按值返回
+  Literal literal(std::size_t index) const {
+    return literal(find(index), index);
+  }
+  symbol::SymbolId symbol(std::size_t index) const {
+    return symbol(find(index), index);
+  }
+  // 还原成完整的 Token，和直接扫描得到的 token 相同
+  Token at(std::size_t index) const { return at(find(index), index); }
+  Token operator[](std::size_t index) const { return at(index); }
+
+  const std::shared_ptr<const source::SourceBuffer> &source() const {
+    return source_;
+  }
+  // 所有数组实际占用的字节数（不含 source；共用的块也算在内）
+  std::size_t memory_usage() const;
+
+private:
+  struct Chunk {
+    std::vector<std::uint8_t> types;
+    std::vector<std::uint32_t> offsets;  // 平移之前的 offset
+    std::vector<std::uint32_t> lengths;
+    // 稀疏表，下标是块内的下标
+    std::vector<std::uint32_t> literal_index;
+    std::vector<Literal> literals;
+    // literals 里字符串字面量的原文在 source 里的位置（平移之前）
+    std::vector<std::uint32_t> string_offsets;
+    std::vector<std::uint32_t> symbol_index;
+    std::vector<symbol::SymbolId> symbols;
+  };
+  // chunk 的 [begin, end)，offset 加上 shift；start 是第一个 token 在
+  // stream 里的下标
+  struct Piece {
+    std::shared_ptr<const Chunk> chunk;
+    std::uint32_t begin;
+    std::uint32_t end;
+    std::int64_t shift;
+    std::size_t start;
+
+    std::size_t local(std::size_t index) const { return begin + (index - start); }
+    bool holds(std::size_t index) const {
+      return index >= start && index - start < end - begin;
+    }
+  };
+
+  const Piece &find(std::size_t index) const {
+    // 没有拼接过的 stream 除最后一段外都是满块，直接算出是第几段
+    if (uniform_)
+      return pieces_[index / kChunkTokens];
+    return search(index);
+  }
+  const Piece &search(std::size_t index) const;
+  void add_piece(Piece piece);
+
+  // piece 是 index 所在的片段
+  TokenType type(const Piece &piece, std::size_t index) const {
+    return static_cast<TokenType>(piece.chunk->types[piece.local(index)]);
+  }
+  std::size_t offset(const Piece &piece, std::size_t index) const {
+    return static_cast<std::size_t>(piece.chunk->offsets[piece.local(index)] +
+                                    piece.shift);
+  }
+  std::size_t length(const Piece &piece, std::size_t index) const {
+    return piece.chunk->lengths[piece.local(index)];
+  }
+  Literal literal(const Piece &piece, std::size_t index) const;
+  symbol::SymbolId symbol(const Piece &piece, std::size_t index) const;
+  Token at(const Piece &piece, std::size_t index) const;
+
+private:
+  std::shared_ptr<const source::SourceBuffer> source_;
+  std::vector<Piece> pieces_;
+  // 正在写的块；只有最后一段正好停在它的末尾时才接着写
+  std::shared_ptr<Chunk> tail_;
+  std::size_t size_ = 0;
+  bool uniform_ = true;
+};
+
+}  // namespace token
+}  // namespace dtoy
@@ -0,0 +1,68 @@
+#include "ast.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <utility>
+
+namespace dtoy {
+namespace ast {
+
+AstArena::~AstArena() {
+  for (Finalizer *finalizer = finalizers_; finalizer != nullptr;) {
+    // destroy 之后不会再碰节点；记录本身在节点前面，单独保存 next
+    Finalizer *next = finalizer->next;
+    finalizer->destroy(finalizer->object);
+    finalizer = next;
+  }
+}
+
+void AstArena::absorb(AstArena &&other) {
+  if (&other == this)
+    return;
+  blocks_.reserve(blocks_.size() + other.blocks_.size());
+  for (auto &block : other.blocks_)
+    blocks_.push_back(std::move(block));
+  other.blocks_.clear();
+  used_ += std::exchange(other.used_, 0);
+  other.cursor_ = other.limit_ = nullptr;
+
+  // other 的节点接在链表前面，析构顺序不影响结果：节点之间只有裸指针
+  if (other.finalizers_ != nullptr) {
+    other.last_finalizer_->next = finalizers_;
+    finalizers_ = other.finalizers_;
+    if (last_finalizer_ == nullptr)
+      last_finalizer_ = other.last_finalizer_;
+  }
+  other.finalizers_ = other.last_finalizer_ = nullptr;
+}
+
+std::string_view AstArena::copy_string(std::string_view text) {
+  if (text.empty())
+    return {};
+  auto *memory = static_cast<char *>(allocate(text.size(), 1));
+  std::memcpy(memory, text.data(), text.size());
+  return {memory, text.size()};
+}
+
+bool AstArena::owns(const void *pointer) const {
+  auto *address = static_cast<const std::byte *>(pointer);
+  return std::any_of(blocks_.begin(), blocks_.end(), [&](const Block &block) {
+    return std::less_equal<>()(block.memory.get(), address) &&
+           std::less<>()(address, block.memory.get() + block.size);
+  });
+}
+
+void *AstArena::grow(std::size_t size, std::size_t align) {
+  // new[] 只保证 __STDCPP_DEFAULT_NEW_ALIGNMENT__，多留出对齐的余量；
+  // 不用 make_unique，省掉清零
+  std::size_t capacity = std::max(kBlockSize, size + align);
+  blocks_.push_back({std::unique_ptr<std::byte[]>(new std::byte[capacity]),
+                     capacity});
+  cursor_ = blocks_.back().memory.get();
+  limit_ = cursor_ + capacity;
+  return allocate(size, align);
+}
+
+}  // namespace ast
+}  // namespace dtoy
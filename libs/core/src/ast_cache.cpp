@@ -0,0 +1,338 @@
+#include "ast_cache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <random>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+#include "symbol.h"
+#include "token.h"
+
+// 由 CMake 按 PROJECT_VERSION 定义
+#ifndef DTOY_VERSION
+#define DTOY_VERSION "unknown"
+#endif
+
+namespace dtoy {
+namespace ast {
+namespace {
+
+constexpr char kMagic[8] = {'D', 'T', 'A', 'S', 'T', '\r', '\n', '\x1a'};
+constexpr std::uint32_t kByteOrder = 0x01020304;
+
+enum Section {
+  Kinds,
+  Ops,
+  Operands,
+  Offsets,
+  Integers,
+  Doubles,
+  Text,
+  Statements,
+  NameOffsets,  // 第 i 个变量名是 names[offsets[i], offsets[i + 1])
+  Names,
+  kSectionCount,
+};
+
+constexpr std::size_t kElementSize[kSectionCount] = {1, 1, 4, 4, 8,
+                                                     8, 1, 4, 4, 1};
+
+struct Header {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t build;  // AstCache::build_id()
+  std::uint64_t key;
+  std::uint64_t counts[kSectionCount];  // 每段的元素个数
+};
+
+constexpr std::size_t kAlign = 8;
+
+std::size_t align(std::size_t size) { return (size + kAlign - 1) & ~(kAlign - 1); }
+
+}  // namespace
+
+std::uint64_t AstCache::hash(std::string_view bytes, std::uint64_t seed) {
+  constexpr std::uint64_t kMultiplier = 0x9E3779B97F4A7C15ull;
+  auto mix = [](std::uint64_t state, std::uint64_t word) {
+    state = (state ^ word) * kMultiplier;
+    return state ^ (state >> 32);
+  };
+  std::uint64_t state = mix(seed, bytes.size());
+  std::size_t i = 0;
+  for (; i + 8 <= bytes.size(); i += 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes.data() + i, 8);
+    state = mix(state, word);
+  }
+  std::uint64_t tail = 0;
+  std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+  return mix(mix(state, tail), kMultiplier);
+}
+
+std::uint64_t AstCache::build_id() {
+  static const std::uint64_t id = [] {
+    std::uint64_t state = hash(DTOY_VERSION, kVersion);
+    // 文件布局
+    std::uint64_t layout[] = {sizeof(Header),
+                              kSectionCount,
+                              static_cast<std::uint64_t>(FlatAst::Kind::Var),
+                              sizeof(symbol::SymbolId)};
+    state = hash(std::string_view(reinterpret_cast<const char *>(layout),
+                                  sizeof(layout)),
+                 state);
+    state = hash(std::string_view(reinterpret_cast<const char *>(kElementSize),
+                                  sizeof(kElementSize)),
+                 state);
+    // op 里存的是 TokenType 的值，运算符换了编号旧文件就读错
+    for (std::size_t type = 0; type < token::kTokenTypeCount; ++type)
+      state = hash(token::spelling(static_cast<token::TokenType>(type)), state);
+    return state;
+  }();
+  return id;
+}
+
+std::uint64_t AstCache::key(const source::SourceBuffer &source, bool folded) {
+  return hash(source.view(), (build_id() << 1) | folded);
+}
+
+std::string AstCache::path_for(const std::string &script) {
+  if (script.size() > 3 && script.ends_with(".dt"))
+    return script + "ast";
+  return script + ".dtast";
+}
+
+bool AstCache::store(const std::string &path, const FlatAst &tree,
+                     std::uint64_t key) {
+  try {
+    std::string names;
+    std::vector<std::uint32_t> name_offsets{0};
+    for (symbol::SymbolId id : tree.symbols_) {
+      if (id == symbol::kNoSymbol)
+        return false;  // 手工构造、没有驻留过的名字
+      names += symbol::SymbolTable::global().name(id);
+      name_offsets.push_back(static_cast<std::uint32_t>(names.size()));
+    }
+
+    const void *sections[kSectionCount] = {
+        tree.kinds_.data(),    tree.ops_.data(),      tree.operands_.data(),
+        tree.offsets_.data(),  tree.integers_.data(), tree.doubles_.data(),
+        tree.text_.data(),     tree.statements_.data(), name_offsets.data(),
+        names.data()};
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrder;
+    header.build = build_id();
+    header.key = key;
+    header.counts[Kinds] = tree.kinds_.size();
+    header.counts[Ops] = tree.ops_.size();
+    header.counts[Operands] = tree.operands_.size();
+    header.counts[Offsets] = tree.offsets_.size();
+    header.counts[Integers] = tree.integers_.size();
+    header.counts[Doubles] = tree.doubles_.size();
+    header.counts[Text] = tree.text_.size();
+    header.counts[Statements] = tree.statements_.size();
+    header.counts[NameOffsets] = name_offsets.size();
+    header.counts[Names] = names.size();
+
+    std::string temp =
+        path + ".tmp" + std::to_string(std::random_device{}());
+    {
+      std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+      const char padding[kAlign] = {};
+      for (int section = 0; section < kSectionCount; ++section) {
+        std::size_t bytes = header.counts[section] * kElementSize[section];
+        if (bytes != 0)
+          out.write(static_cast<const char *>(sections[section]),
+                    static_cast<std::streamsize>(bytes));
+        out.write(padding, static_cast<std::streamsize>(align(bytes) - bytes));
+      }
+      out.close();
+      if (!out) {
+        std::remove(temp.c_str());
+        return false;
+      }
+    }
+    if (std::rename(temp.c_str(), path.c_str()) != 0) {
+      std::remove(temp.c_str());
+      return false;
+    }
+    return true;
+  } catch (const std::exception &) {
+    return false;
+  }
+}
+
+std::optional<FlatAst>
+AstCache::load(const std::string &path,
+               std::shared_ptr<const source::SourceBuffer> source,
+               std::uint64_t key) {
+  std::shared_ptr<const source::SourceBuffer> image;
+  try {
+    image = source::SourceBuffer::open(path);
+  } catch (const std::exception &) {
+    return std::nullopt;
+  }
+  // 映射是按页对齐的；读进内存的退路由 std::string 的分配保证对齐
+  if (image->size() < sizeof(Header) ||
+      reinterpret_cast<std::uintptr_t>(image->data()) % kAlign != 0)
+    return std::nullopt;
+
+  Header header;
+  std::memcpy(&header, image->data(), sizeof(header));
+  const std::uint64_t *counts = header.counts;
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kVersion || header.byte_order != kByteOrder ||
+      header.build != build_id() || header.key != key)
+    return std::nullopt;
+  if (counts[Ops] != counts[Kinds] || counts[Operands] != counts[Kinds] ||
+      counts[Offsets] != counts[Kinds] || counts[NameOffsets] == 0)
+    return std::nullopt;
+
+  const char *sections[kSectionCount];
+  std::size_t position = sizeof(Header);
+  for (int section = 0; section < kSectionCount; ++section) {
+    if (position > image->size() ||
+        counts[section] > (image->size() - position) / kElementSize[section])
+      return std::nullopt;
+    sections[section] = image->data() + position;
+    position = align(position + counts[section] * kElementSize[section]);
+  }
+  if (position != image->size())
+    return std::nullopt;
+
+  FlatAst tree;
+  tree.source_ = std::move(source);
+  tree.image_ = image;
+  auto borrow = [&](auto &column, Section section) {
+    using T = std::remove_cvref_t<decltype(column[0])>;
+    column.borrow(std::span<const T>(
+        reinterpret_cast<const T *>(sections[section]), counts[section]));
+  };
+  borrow(tree.kinds_, Kinds);
+  borrow(tree.ops_, Ops);
+  borrow(tree.operands_, Operands);
+  borrow(tree.offsets_, Offsets);
+  borrow(tree.integers_, Integers);
+  borrow(tree.doubles_, Doubles);
+  borrow(tree.text_, Text);
+  borrow(tree.statements_, Statements);
+
+  // 变量名按文件里的顺序重新驻留
+  std::span<const std::uint32_t> name_offsets(
+      reinterpret_cast<const std::uint32_t *>(sections[NameOffsets]),
+      counts[NameOffsets]);
+  if (name_offsets.front() != 0 || name_offsets.back() != counts[Names])
+    return std::nullopt;
+  tree.symbols_.reserve(name_offsets.size() - 1);
+  for (std::size_t i = 0; i + 1 < name_offsets.size(); ++i) {
+    if (name_offsets[i] > name_offsets[i + 1])
+      return std::nullopt;
+    tree.symbols_.push_back(symbol::SymbolTable::global().intern(
+        std::string_view(sections[Names] + name_offsets[i],
+                         name_offsets[i + 1] - name_offsets[i])));
+  }
+
+  if (!validate(tree))
+    return std::nullopt;
+  return tree;
+}
+
+bool AstCache::validate(const FlatAst &tree) {
+  using Kind = FlatAst::Kind;
+  const std::uint64_t source_size = tree.source_ ? tree.source_->size() : 0;
+  // 和解释器的值栈一一对应，记的是栈上每个值所在子树的第一个节点
+  std::vector<std::uint32_t> starts;
+  std::size_t statement = 0;
+
+  auto operand_below = [&tree](std::uint32_t i, std::size_t limit) {
+    return tree.operands_[i] < limit;
+  };
+  auto end_statement = [&](std::uint32_t i, std::size_t values) {
+    if (starts.size() != values || statement >= tree.statements_.size() ||
+        tree.statements_[statement] != i)
+      return false;
+    starts.clear();
+    ++statement;
+    return true;
+  };
+
+  for (std::uint32_t i = 0; i < tree.size(); ++i) {
+    if (tree.kinds_[i] > static_cast<std::uint8_t>(Kind::Var))
+      return false;
+    switch (tree.kind(i)) {
+    case Kind::Nil:
+    case Kind::True:
+    case Kind::False:
+    case Kind::Char:
+      starts.push_back(i);
+      break;
+    case Kind::Integer:
+      if (tree.ops_[i] == 0 && !operand_below(i, tree.integers_.size()))
+        return false;
+      starts.push_back(i);
+      break;
+    case Kind::Double:
+      if (!operand_below(i, tree.doubles_.size()))
+        return false;
+      starts.push_back(i);
+      break;
+    case Kind::String:
+      if (std::uint64_t{tree.offsets_[i]} + tree.operands_[i] > source_size)
+        return false;
+      starts.push_back(i);
+      break;
+    case Kind::Text:
+      if (std::uint64_t{tree.offsets_[i]} + tree.operands_[i] >
+          tree.text_.size())
+        return false;
+      starts.push_back(i);
+      break;
+    case Kind::Variable:
+      if (!operand_below(i, tree.symbols_.size()))
+        return false;
+      starts.push_back(i);
+      break;
+    case Kind::Assign:
+      if (!operand_below(i, tree.symbols_.size()) || starts.empty())
+        return false;
+      break;
+    case Kind::Unary:
+      if (tree.ops_[i] >= token::kTokenTypeCount || starts.empty())
+        return false;
+      break;
+    case Kind::Grouping:
+      if (starts.empty())
+        return false;
+      break;
+    case Kind::Binary: {
+      // 左子树紧挨在右子树前面
+      if (tree.ops_[i] >= token::kTokenTypeCount || starts.size() < 2 ||
+          tree.operands_[i] + 1 != starts.back())
+        return false;
+      starts.pop_back();
+      break;
+    }
+    case Kind::Expression:
+    case Kind::Print:
+      if (!end_statement(i, 1))
+        return false;
+      break;
+    case Kind::Var:
+      if (!operand_below(i, tree.symbols_.size()) ||
+          !end_statement(i, tree.ops_[i] != 0 ? 1 : 0))
+        return false;
+      break;
+    }
+  }
+  return starts.empty() && statement == tree.statements_.size();
+}
+
+}  // namespace ast
+}  // namespace dtoy
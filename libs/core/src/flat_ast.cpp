@@ -0,0 +1,279 @@
+#include "flat_ast.h"
+
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <variant>
+
+namespace dtoy {
+namespace ast {
+namespace {
+
+constexpr std::size_t kMaxIndex = std::numeric_limits<std::uint32_t>::max();
+
+// 后序遍历用的显式栈帧；expanded 表示子节点已经入栈
+struct Frame {
+  const expr::Expr *expr;
+  const stmt::Stmt *stmt;
+  bool expanded;
+};
+
+}  // namespace
+
+FlatAst FlatAst::build(const Program &program,
+                       std::shared_ptr<const source::SourceBuffer> source) {
+  FlatAst tree;
+  tree.source_ = std::move(source);
+
+  std::vector<Frame> pending;
+  std::vector<std::uint32_t> done;  // 已经输出、还没被父节点取走的子树根
+  auto take = [&done] {
+    std::uint32_t index = done.back();
+    done.pop_back();
+    return index;
+  };
+  // 子节点逆序入栈，左边的先输出
+  auto expand = [&pending](const expr::Expr *child) {
+    if (child != nullptr)
+      pending.push_back({child, nullptr, false});
+  };
+  std::unordered_map<symbol::SymbolId, std::uint32_t> locals;
+  auto local = [&](const token::Name &name) {
+    auto [found, inserted] = locals.try_emplace(
+        name.symbol(), static_cast<std::uint32_t>(tree.symbols_.size()));
+    if (inserted)
+      tree.symbols_.push_back(name.symbol());
+    return found->second;
+  };
+
+  for (std::size_t i = 0; i < program.size(); ++i) {
+    const stmt::Stmt *statement = program[i];
+    // 增量解析沿用的语句只记了平移（见 Program::shift()），在这里补上
+    auto at = [shift = program.shift(i)](std::size_t offset) {
+      return offset + static_cast<std::size_t>(shift);
+    };
+    pending.push_back({nullptr, statement, false});
+    while (!pending.empty()) {
+      Frame frame = pending.back();
+      pending.pop_back();
+
+      if (!frame.expanded) {
+        pending.push_back({frame.expr, frame.stmt, true});
+        if (frame.expr != nullptr) {
+          std::visit(
+              [&](const auto &node) {
+                using T = std::decay_t<decltype(node)>;
+                if constexpr (std::is_same_v<T, expr::BinaryExpr>) {
+                  expand(node.right);
+                  expand(node.left);
+                } else if constexpr (std::is_same_v<T, expr::UnaryExpr>) {
+                  expand(node.right);
+                } else if constexpr (std::is_same_v<T, expr::GroupingExpr>) {
+                  expand(node.expression);
+                } else if constexpr (std::is_same_v<T, expr::AssignExpr>) {
+                  expand(node.value);
+                } else if constexpr (std::is_same_v<T, expr::CachedExpr>) {
+                  expand(node.expression);
+                }
+              },
+              *frame.expr);
+        } else {
+          std::visit(
+              [&](const auto &node) {
+                using T = std::decay_t<decltype(node)>;
+                if constexpr (std::is_same_v<T, stmt::VarStmt>) {
+                  expand(node.initializer);
+                } else if constexpr (std::is_same_v<T, stmt::BlockStmt>) {
+                  // parser 还不会产生块语句
+                  throw std::invalid_argument(
+                      "Block statements have no flat form.");
+                } else {
+                  expand(node.expression);
+                }
+              },
+              *frame.stmt);
+        }
+        continue;
+      }
+
+      std::uint32_t index = 0;
+      if (frame.expr != nullptr) {
+        index = std::visit(
+            [&](const auto &node) -> std::uint32_t {
+              using T = std::decay_t<decltype(node)>;
+              if constexpr (std::is_same_v<T, expr::BinaryExpr>) {
+                take();  // 右子节点就在前一个位置
+                std::uint32_t left = take();
+                return tree.push(Kind::Binary,
+                                 static_cast<std::uint8_t>(node.op.type()),
+                                 left, at(node.op.offset()));
+              } else if constexpr (std::is_same_v<T, expr::UnaryExpr>) {
+                take();
+                return tree.push(Kind::Unary,
+                                 static_cast<std::uint8_t>(node.op.type()), 0,
+                                 at(node.op.offset()));
+              } else if constexpr (std::is_same_v<T, expr::GroupingExpr>) {
+                take();
+                return tree.push(Kind::Grouping, 0, 0, 0);
+              } else if constexpr (std::is_same_v<T, expr::AssignExpr>) {
+                take();
+                return tree.push(Kind::Assign, 0, local(node.name),
+                                 at(node.name.offset()));
+              } else if constexpr (std::is_same_v<T, expr::VariableExpr>) {
+                return tree.push(Kind::Variable, 0, local(node.name),
+                                 at(node.name.offset()));
+              } else if constexpr (std::is_same_v<T, expr::CachedExpr>) {
+                // 扁平形式按出现的位置各展开一份
+                return take();
+              } else {
+                return tree.push_literal(node.value);
+              }
+            },
+            *frame.expr);
+      } else {
+        index = std::visit(
+            [&](const auto &node) -> std::uint32_t {
+              using T = std::decay_t<decltype(node)>;
+              if constexpr (std::is_same_v<T, stmt::VarStmt>) {
+                bool initialized = node.initializer != nullptr;
+                if (initialized)
+                  take();
+                return tree.push(Kind::Var, initialized, local(node.name),
+                                 at(node.name.offset()));
+              } else if constexpr (std::is_same_v<T, stmt::PrintStmt>) {
+                take();
+                return tree.push(Kind::Print, 0, 0, 0);
+              } else {
+                take();
+                return tree.push(Kind::Expression, 0, 0, 0);
+              }
+            },
+            *frame.stmt);
+      }
+      done.push_back(index);
+    }
+    tree.statements_.push_back(take());
+  }
+  tree.shrink_to_fit();
+  return tree;
+}
+
+void FlatAst::shrink_to_fit() {
+  kinds_.shrink_to_fit();
+  ops_.shrink_to_fit();
+  operands_.shrink_to_fit();
+  offsets_.shrink_to_fit();
+  integers_.shrink_to_fit();
+  doubles_.shrink_to_fit();
+  text_.shrink_to_fit();
+  statements_.shrink_to_fit();
+  symbols_.shrink_to_fit();
+}
+
+std::uint32_t FlatAst::push(Kind kind, std::uint8_t op, std::uint32_t operand,
+                            std::size_t offset) {
+  if (kinds_.size() >= kMaxIndex || offset > kMaxIndex)
+    throw std::length_error("Program is too large for a FlatAst.");
+  auto index = static_cast<std::uint32_t>(kinds_.size());
+  kinds_.push_back(static_cast<std::uint8_t>(kind));
+  ops_.push_back(op);
+  operands_.push_back(operand);
+  offsets_.push_back(static_cast<std::uint32_t>(offset));
+  return index;
+}
+
+std::uint32_t FlatAst::push_literal(const token::Constant &value) {
+  return std::visit(
+      [this](const auto &literal) -> std::uint32_t {
+        using T = std::decay_t<decltype(literal)>;
+        if constexpr (std::is_same_v<T, bool>) {
+          return push(literal ? Kind::True : Kind::False, 0, 0, 0);
+        } else if constexpr (std::is_same_v<T, std::int64_t>) {
+          // 大多数整数放得进 operand，不占 integers_
+          if (literal >= 0 && static_cast<std::uint64_t>(literal) <= kMaxIndex)
+            return push(Kind::Integer, 1, static_cast<std::uint32_t>(literal),
+                        0);
+          integers_.push_back(literal);
+          return push(Kind::Integer, 0,
+                      static_cast<std::uint32_t>(integers_.size() - 1), 0);
+        } else if constexpr (std::is_same_v<T, double>) {
+          doubles_.push_back(literal);
+          return push(Kind::Double, 0,
+                      static_cast<std::uint32_t>(doubles_.size() - 1), 0);
+        } else if constexpr (std::is_same_v<T, char>) {
+          return push(Kind::Char, 0, static_cast<unsigned char>(literal), 0);
+        } else if constexpr (std::is_same_v<T, token::StringLiteral>) {
+          if (source_ != nullptr && source_->contains(literal.raw()))
+            return push(Kind::String, literal.escaped(),
+                        static_cast<std::uint32_t>(literal.raw().size()),
+                        source_->offset_of(literal.raw()));
+          // 折叠出来的字符串不在 source 里，解码后复制一份
+          std::string text = literal.value();
+          std::size_t position = text_.size();
+          text_.append(text.data(), text.size());
+          return push(Kind::Text, 0, static_cast<std::uint32_t>(text.size()),
+                      position);
+        } else {
+          // nullptr 和 monostate 都是 nil
+          return push(Kind::Nil, 0, 0, 0);
+        }
+      },
+      value);
+}
+
+token::Literal FlatAst::literal(std::uint32_t index) const {
+  switch (kind(index)) {
+  case Kind::Nil: return nullptr;
+  case Kind::True: return true;
+  case Kind::False: return false;
+  case Kind::Integer:
+    if (ops_[index] != 0)
+      return static_cast<std::int64_t>(operands_[index]);
+    return integers_[operands_[index]];
+  case Kind::Double: return doubles_[operands_[index]];
+  case Kind::Char: return static_cast<char>(operands_[index]);
+  case Kind::String:
+    return token::StringLiteral(
+        source_->slice(offsets_[index], operands_[index]), ops_[index] != 0);
+  case Kind::Text:
+    return std::string(text_.data() + offsets_[index], operands_[index]);
+  default: throw std::logic_error("Node is not a literal.");
+  }
+}
+
+std::uint32_t FlatAst::subtree_begin(std::uint32_t index) const {
+  // 一直走到第一个子节点，直到叶子
+  while (true) {
+    switch (kind(index)) {
+    case Kind::Binary:
+      index = left(index);
+      break;
+    case Kind::Unary:
+    case Kind::Grouping:
+    case Kind::Assign:
+    case Kind::Expression:
+    case Kind::Print:
+      index = operand(index);
+      break;
+    case Kind::Var:
+      if (!has_initializer(index))
+        return index;
+      index = operand(index);
+      break;
+    default:
+      return index;
+    }
+  }
+}
+
+std::size_t FlatAst::memory_usage() const {
+  return kinds_.capacity_bytes() + ops_.capacity_bytes() +
+         operands_.capacity_bytes() + offsets_.capacity_bytes() +
+         integers_.capacity_bytes() + doubles_.capacity_bytes() +
+         text_.capacity_bytes() + statements_.capacity_bytes() +
+         symbols_.capacity() * sizeof(symbol::SymbolId);
+}
+
+}  // namespace ast
+}  // namespace dtoy
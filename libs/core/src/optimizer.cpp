@@ -0,0 +1,666 @@
+#include "optimizer.h"
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "interpreter.h"
+#include "stmt.h"
+
+namespace dtoy {
+namespace optimizer {
+namespace {
+
+using token::Constant;
+using token::Literal;
+using token::TokenType;
+
+// 表达式的静态类型，含义是“求值不出错时结果一定是这个类型”。
+// 只用来判断恒等化简是否安全，拿不准的都是 Unknown
+enum class Type { Unknown, Bool, Integer, Double, Number, String };
+
+Type type_of(const Constant &value) {
+  if (std::holds_alternative<bool>(value))
+    return Type::Bool;
+  if (std::holds_alternative<std::int64_t>(value))
+    return Type::Integer;
+  if (std::holds_alternative<double>(value))
+    return Type::Double;
+  if (std::holds_alternative<token::StringLiteral>(value))
+    return Type::String;
+  return Type::Unknown;
+}
+
+const Constant *literal_of(const expr::Expr *expr) {
+  auto literal = std::get_if<expr::LiteralExpr>(expr);
+  return literal == nullptr ? nullptr : &literal->value;
+}
+
+Type unary_type(TokenType op, Type operand) {
+  if (op == TokenType::BANG)
+    return Type::Bool;
+  return operand == Type::Integer || operand == Type::Double ? operand
+                                                             : Type::Number;
+}
+
+Type binary_type(TokenType op, Type left, Type right) {
+  switch (op) {
+  case TokenType::BANG_EQUAL:
+  case TokenType::EQUAL_EQUAL:
+  case TokenType::GREATER:
+  case TokenType::GREATER_EQUAL:
+  case TokenType::LESS:
+  case TokenType::LESS_EQUAL:
+    return Type::Bool;
+  case TokenType::MINUS:
+  case TokenType::STAR:
+  case TokenType::SLASH:
+    // 只接受两个同类型的数
+    if (left == right && (left == Type::Integer || left == Type::Double))
+      return left;
+    return Type::Number;
+  case TokenType::PLUS:
+    if (left == right && left != Type::Bool && left != Type::Number)
+      return left;
+    return Type::Unknown;
+  default:
+    return Type::Unknown;
+  }
+}
+
+// value 在 op 的这一侧是不是 other 类型的单位元：x + 0、x * 1、"" + s 等。
+// 浮点数的 x + 0.0 会把 -0.0 变成 0.0，不算
+bool is_identity(TokenType op, const Constant &value, bool on_right,
+                 Type other) {
+  if (auto integer = std::get_if<std::int64_t>(&value);
+      integer != nullptr && other == Type::Integer) {
+    switch (op) {
+    case TokenType::PLUS: return *integer == 0;
+    case TokenType::MINUS: return on_right && *integer == 0;
+    case TokenType::STAR: return *integer == 1;
+    case TokenType::SLASH: return on_right && *integer == 1;
+    default: return false;
+    }
+  }
+  if (auto real = std::get_if<double>(&value);
+      real != nullptr && other == Type::Double) {
+    switch (op) {
+    case TokenType::MINUS:
+      return on_right && *real == 0.0 && !std::signbit(*real);
+    case TokenType::STAR: return *real == 1.0;
+    case TokenType::SLASH: return on_right && *real == 1.0;
+    default: return false;
+    }
+  }
+  if (op == TokenType::PLUS && other == Type::String) {
+    Literal decoded = token::value_of(value);
+    auto text = std::get_if<std::string>(&decoded);
+    return text != nullptr && text->empty();
+  }
+  return false;
+}
+
+class Folder {
+public:
+  Folder(FoldStats &stats, ast::AstArena &arena)
+      : stats_(stats), arena_(arena) {}
+
+  // 显式栈做后序遍历：子节点先化简，再看父节点；再深的树也不会递归
+  void fold(expr::Expr *&root) {
+    std::vector<Frame> pending{{&root, false}};
+    std::vector<Type> types;  // 已经化简的子表达式的类型
+    while (!pending.empty()) {
+      Frame frame = pending.back();
+      pending.pop_back();
+      if (frame.expanded) {
+        Type type = simplify(*frame.slot, types);
+        types.push_back(type);
+        continue;
+      }
+      pending.push_back({frame.slot, true});
+      std::visit(
+          [&pending](auto &node) {
+            using T = std::decay_t<decltype(node)>;
+            if constexpr (std::is_same_v<T, expr::BinaryExpr>) {
+              pending.push_back({&node.right, false});
+              pending.push_back({&node.left, false});
+            } else if constexpr (std::is_same_v<T, expr::UnaryExpr>) {
+              pending.push_back({&node.right, false});
+            } else if constexpr (std::is_same_v<T, expr::GroupingExpr>) {
+              pending.push_back({&node.expression, false});
+            } else if constexpr (std::is_same_v<T, expr::AssignExpr>) {
+              pending.push_back({&node.value, false});
+            }
+          },
+          **frame.slot);
+    }
+  }
+
+  void fold(stmt::Stmt &statement) {
+    std::visit(
+        [this](auto &node) {
+          using T = std::decay_t<decltype(node)>;
+          if constexpr (std::is_same_v<T, stmt::VarStmt>) {
+            if (node.initializer != nullptr)
+              fold(node.initializer);
+          } else if constexpr (std::is_same_v<T, stmt::BlockStmt>) {
+            for (stmt::Stmt *child : node.statements)
+              fold(*child);
+          } else {
+            fold(node.expression);
+          }
+        },
+        statement);
+  }
+
+private:
+  struct Frame {
+    expr::Expr **slot;
+    bool expanded;
+  };
+
+  // 子节点都已经化简，它们的类型在 types 栈顶；slot 可能被换成子节点
+  Type simplify(expr::Expr *&slot, std::vector<Type> &types) {
+    auto pop = [&types] {
+      Type type = types.back();
+      types.pop_back();
+      return type;
+    };
+    expr::Expr &node = *slot;
+
+    if (auto literal = std::get_if<expr::LiteralExpr>(&node))
+      return type_of(literal->value);
+    if (auto grouping = std::get_if<expr::GroupingExpr>(&node)) {
+      // 括号只影响解析，AST 里的结构已经表达了优先级
+      slot = grouping->expression;
+      ++stats_.groupings;
+      return pop();
+    }
+    if (std::holds_alternative<expr::AssignExpr>(node))
+      return pop();
+
+    if (auto unary = std::get_if<expr::UnaryExpr>(&node)) {
+      Type operand = pop();
+      token::Operator op = unary->op;
+      if (const Constant *value = literal_of(unary->right)) {
+        if (auto result = evaluate([&] {
+              return interpreter_.unary(op, token::value_of(*value));
+            }))
+          return replace(node, *result);
+      }
+      // --x 和 !!x：x 一定是浮点数（或者 bool）时才等于 x，否则会吞掉
+      // 类型错误；整数的 -x 在 x 是 INT64_MIN 时溢出报错，也不能去掉
+      auto inner = std::get_if<expr::UnaryExpr>(unary->right);
+      if (inner != nullptr && inner->op.type() == op.type()) {
+        auto found = unary_operand_.find(unary->right);
+        Type type = found == unary_operand_.end() ? Type::Unknown : found->second;
+        if (op.type() == TokenType::MINUS ? type == Type::Double
+                                          : type == Type::Bool) {
+          slot = inner->right;
+          ++stats_.identities;
+          return type;
+        }
+      }
+      unary_operand_[&node] = operand;
+      return unary_type(op.type(), operand);
+    }
+
+    if (auto binary = std::get_if<expr::BinaryExpr>(&node)) {
+      Type right = pop();
+      Type left = pop();
+      token::Operator op = binary->op;
+      const Constant *left_value = literal_of(binary->left);
+      const Constant *right_value = literal_of(binary->right);
+      if (left_value != nullptr && right_value != nullptr) {
+        if (auto result = evaluate([&] {
+              return interpreter_.binary(op, token::value_of(*left_value),
+                                         token::value_of(*right_value));
+            }))
+          return replace(node, *result);
+      }
+      if (right_value != nullptr &&
+          is_identity(op.type(), *right_value, true, left)) {
+        slot = binary->left;
+        ++stats_.identities;
+        return left;
+      }
+      if (left_value != nullptr &&
+          is_identity(op.type(), *left_value, false, right)) {
+        slot = binary->right;
+        ++stats_.identities;
+        return right;
+      }
+      return binary_type(op.type(), left, right);
+    }
+    return Type::Unknown;  // VariableExpr
+  }
+
+  // 运行时会报错的运算不折叠，留到运行时按原样报错
+  template <typename Compute>
+  std::optional<Literal> evaluate(Compute &&compute) {
+    try {
+      return compute();
+    } catch (const interpreter::RuntimeError &) {
+      return std::nullopt;
+    }
+  }
+
+  // 节点原地换成字面量，内存还是 arena 里的那一块；
+  // 字符串结果也复制进 arena，节点本身不持有堆内存
+  Type replace(expr::Expr &node, const Literal &value) {
+    Constant constant = token::constant_of(value, arena_);
+    node = expr::LiteralExpr(constant);
+    Type type = type_of(constant);
+    ++stats_.folded;
+    return type;
+  }
+
+private:
+  FoldStats &stats_;
+  ast::AstArena &arena_;
+  interpreter::Interpreter interpreter_;
+  // 一元运算节点的操作数类型，外层判断 --x / !!x 时用
+  std::unordered_map<const expr::Expr *, Type> unary_operand_;
+};
+
+// 运算在这些操作数类型下一定不会抛出 RuntimeError；除法可能除以 0，
+// 整数的加减乘可能溢出
+bool cannot_fail(TokenType op, Type left, Type right) {
+  switch (op) {
+  case TokenType::EQUAL_EQUAL:
+  case TokenType::BANG_EQUAL:
+    return true;
+  case TokenType::PLUS:
+    return left == right && (left == Type::Double || left == Type::String);
+  case TokenType::MINUS:
+  case TokenType::STAR:
+    return left == right && left == Type::Double;
+  case TokenType::GREATER:
+  case TokenType::GREATER_EQUAL:
+  case TokenType::LESS:
+  case TokenType::LESS_EQUAL:
+    return left == right && (left == Type::Integer || left == Type::Double);
+  default:
+    return false;
+  }
+}
+
+bool cannot_fail(TokenType op, Type operand) {
+  if (op == TokenType::BANG)
+    return operand == Type::Bool;
+  return op == TokenType::MINUS && operand == Type::Double;
+}
+
+// 表达式的结构：子节点在分析时是编号，建树时是新节点的地址
+struct Key {
+  std::size_t kind;     // Expr 的 variant 下标
+  std::size_t op;       // 运算符，或者字面量的 variant 下标
+  std::uint64_t value;  // symbol id、字面量的值
+  std::uintptr_t left = 0;
+  std::uintptr_t right = 0;
+
+  bool operator==(const Key &) const = default;
+};
+
+struct KeyHash {
+  std::size_t operator()(const Key &key) const {
+    std::uint64_t hash = key.kind;
+    for (std::uint64_t part : {static_cast<std::uint64_t>(key.op), key.value,
+                               static_cast<std::uint64_t>(key.left),
+                               static_cast<std::uint64_t>(key.right)})
+      hash = (hash ^ part) * 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(hash ^ (hash >> 32));
+  }
+};
+
+template <typename T> constexpr std::size_t kExprIndex = [] {
+  std::size_t index = 0;
+  [&]<std::size_t... I>(std::index_sequence<I...>) {
+    ((std::is_same_v<T, std::variant_alternative_t<I, expr::ExprBase>>
+          ? (index = I, true)
+          : false) ||
+     ...);
+  }(std::make_index_sequence<std::variant_size_v<expr::ExprBase>>{});
+  return index;
+}();
+
+class Sharer {
+public:
+  Sharer(ShareStats &stats, const ast::AstArena &from, ast::AstArena &arena)
+      : stats_(stats), from_(from), arena_(arena) {}
+
+  // 语句复制到新的 arena，表达式按规则合并
+  stmt::Stmt *copy(const stmt::Stmt &statement) {
+    return std::visit(
+        [this](const auto &node) -> stmt::Stmt * {
+          using T = std::decay_t<decltype(node)>;
+          if constexpr (std::is_same_v<T, stmt::VarStmt>) {
+            return arena_.make<stmt::Stmt>(stmt::VarStmt(
+                node.name,
+                node.initializer == nullptr ? nullptr
+                                            : share(node.initializer)));
+          } else if constexpr (std::is_same_v<T, stmt::BlockStmt>) {
+            std::vector<stmt::Stmt *> statements;
+            for (const stmt::Stmt *child : node.statements)
+              statements.push_back(copy(*child));
+            return arena_.make<stmt::Stmt>(
+                stmt::BlockStmt(std::move(statements)));
+          } else {
+            return arena_.make<stmt::Stmt>(T(share(node.expression)));
+          }
+        },
+        statement);
+  }
+
+private:
+  struct Frame {
+    const expr::Expr *node;
+    bool expanded;
+  };
+  struct Shared {
+    expr::Expr *node;
+    Type type;
+    bool safe;  // 求值一定不会抛出 RuntimeError
+  };
+
+  // 按求值顺序（后序、从左到右）把子节点压栈
+  static void expand(std::vector<Frame> &pending, const expr::Expr &node) {
+    std::visit(
+        [&pending](const auto &n) {
+          using T = std::decay_t<decltype(n)>;
+          if constexpr (std::is_same_v<T, expr::BinaryExpr>) {
+            pending.push_back({n.right, false});
+            pending.push_back({n.left, false});
+          } else if constexpr (std::is_same_v<T, expr::UnaryExpr>) {
+            pending.push_back({n.right, false});
+          } else if constexpr (std::is_same_v<T, expr::GroupingExpr> ||
+                               std::is_same_v<T, expr::CachedExpr>) {
+            pending.push_back({n.expression, false});
+          } else if constexpr (std::is_same_v<T, expr::AssignExpr>) {
+            pending.push_back({n.value, false});
+          }
+        },
+        node);
+  }
+
+  static bool cacheable(const expr::Expr &node) {
+    return std::holds_alternative<expr::BinaryExpr>(node) ||
+           std::holds_alternative<expr::UnaryExpr>(node);
+  }
+
+  expr::Expr *share(const expr::Expr *root) {
+    number(root);
+    count_uses(root);
+
+    std::vector<Frame> pending{{root, false}};
+    std::vector<Shared> results;
+    // 这条语句里已经包成 CachedExpr 的子树
+    std::unordered_map<std::uint32_t, Shared> cached;
+    while (!pending.empty()) {
+      Frame frame = pending.back();
+      pending.pop_back();
+      std::uint32_t id = ids_.at(frame.node);
+      if (!frame.expanded) {
+        if (auto found = cached.find(id); found != cached.end()) {
+          results.push_back(found->second);
+          ++stats_.cached;
+          continue;
+        }
+        pending.push_back({frame.node, true});
+        expand(pending, *frame.node);
+        continue;
+      }
+      Shared result = build(*frame.node, results);
+      if (cacheable(*frame.node) && uses_[id] > 1) {
+        result.node = arena_.make<expr::Expr>(expr::CachedExpr(result.node));
+        cached.emplace(id, result);
+      }
+      results.push_back(result);
+    }
+    return results.back().node;
+  }
+
+  // 给这条语句里的每个子树编号，结构相同、读到的变量也相同的编号相同。
+  // 变量读取带上它在这条语句里被赋值的次数，赋值前后的读取编号不同
+  void number(const expr::Expr *root) {
+    ids_.clear();
+    local_.clear();
+    epochs_.clear();
+    std::uint32_t next = 0;
+    std::vector<Frame> pending{{root, false}};
+    std::vector<std::uint32_t> children;
+    auto pop = [&children] {
+      std::uint32_t id = children.back();
+      children.pop_back();
+      return id;
+    };
+    auto intern = [&](const Key &key) {
+      return local_.try_emplace(key, next).first->second;
+    };
+    while (!pending.empty()) {
+      Frame frame = pending.back();
+      pending.pop_back();
+      if (!frame.expanded) {
+        pending.push_back({frame.node, true});
+        expand(pending, *frame.node);
+        continue;
+      }
+      std::uint32_t id = std::visit(
+          [&](const auto &n) -> std::uint32_t {
+            using T = std::decay_t<decltype(n)>;
+            constexpr std::size_t kind = kExprIndex<T>;
+            if constexpr (std::is_same_v<T, expr::BinaryExpr>) {
+              std::uint32_t right = pop();
+              std::uint32_t left = pop();
+              return intern({kind, static_cast<std::size_t>(n.op.type()), 0,
+                             left, right});
+            } else if constexpr (std::is_same_v<T, expr::UnaryExpr>) {
+              return intern(
+                  {kind, static_cast<std::size_t>(n.op.type()), 0, pop()});
+            } else if constexpr (std::is_same_v<T, expr::LiteralExpr>) {
+              return intern({kind, n.value.index(), bits(n.value)});
+            } else if constexpr (std::is_same_v<T, expr::VariableExpr>) {
+              return intern({kind, 0, n.name.symbol(),
+                             epochs_[n.name.symbol()]});
+            } else if constexpr (std::is_same_v<T, expr::AssignExpr>) {
+              pop();
+              ++epochs_[n.name.symbol()];
+              return next++;  // 有副作用，不和任何子树相同
+            } else {
+              return intern({kind, 0, 0, pop()});
+            }
+          },
+          *frame.node);
+      if (id == next)
+        ++next;
+      ids_[frame.node] = id;
+      children.push_back(id);
+    }
+  }
+
+  // 子树在求值时实际会被用到几次：重复的子树从第二次起整个换掉，
+  // 它里面的子树也就不再单独算一次
+  void count_uses(const expr::Expr *root) {
+    std::unordered_map<std::uint32_t, std::size_t> seen;
+    for (const auto &[node, id] : ids_)
+      if (cacheable(*node))
+        ++seen[id];
+    uses_.clear();
+    std::vector<Frame> pending{{root, false}};
+    while (!pending.empty()) {
+      const expr::Expr *node = pending.back().node;
+      pending.pop_back();
+      std::uint32_t id = ids_.at(node);
+      if (cacheable(*node) && seen[id] > 1 && uses_[id]++ > 0)
+        continue;
+      expand(pending, *node);
+    }
+  }
+
+  // 子节点的结果在 results 栈顶；能合并的直接返回已有的节点
+  Shared build(const expr::Expr &node, std::vector<Shared> &results) {
+    auto pop = [&results] {
+      Shared result = results.back();
+      results.pop_back();
+      return result;
+    };
+    return std::visit(
+        [&](const auto &n) -> Shared {
+          using T = std::decay_t<decltype(n)>;
+          constexpr std::size_t kind = kExprIndex<T>;
+          if constexpr (std::is_same_v<T, expr::BinaryExpr>) {
+            Shared right = pop();
+            Shared left = pop();
+            TokenType op = n.op.type();
+            return intern(
+                {kind, static_cast<std::size_t>(op), 0,
+                 reinterpret_cast<std::uintptr_t>(left.node),
+                 reinterpret_cast<std::uintptr_t>(right.node)},
+                binary_type(op, left.type, right.type),
+                left.safe && right.safe && cannot_fail(op, left.type, right.type),
+                [&] {
+                  return expr::BinaryExpr(left.node, n.op, right.node);
+                });
+          } else if constexpr (std::is_same_v<T, expr::UnaryExpr>) {
+            Shared operand = pop();
+            TokenType op = n.op.type();
+            return intern(
+                {kind, static_cast<std::size_t>(op), 0,
+                 reinterpret_cast<std::uintptr_t>(operand.node)},
+                unary_type(op, operand.type),
+                operand.safe && cannot_fail(op, operand.type),
+                [&] { return expr::UnaryExpr(n.op, operand.node); });
+          } else if constexpr (std::is_same_v<T, expr::LiteralExpr>) {
+            return intern({kind, n.value.index(), bits(n.value)},
+                          type_of(n.value), true, [&] { return copied(n); });
+          } else if constexpr (std::is_same_v<T, expr::VariableExpr>) {
+            // 未定义变量的错误不带位置，读取总能合并
+            return intern({kind, 0, n.name.symbol()}, Type::Unknown, true,
+                          [&] { return n; });
+          } else if constexpr (std::is_same_v<T, expr::GroupingExpr>) {
+            Shared inner = pop();
+            return intern({kind, 0, 0,
+                           reinterpret_cast<std::uintptr_t>(inner.node)},
+                          inner.type, inner.safe,
+                          [&] { return expr::GroupingExpr(inner.node); });
+          } else if constexpr (std::is_same_v<T, expr::AssignExpr>) {
+            Shared value = pop();
+            return {arena_.make<expr::Expr>(expr::AssignExpr(n.name, value.node)),
+                    value.type, false};
+          } else {
+            Shared inner = pop();
+            return {arena_.make<expr::Expr>(expr::CachedExpr(inner.node)),
+                    inner.type, inner.safe};
+          }
+        },
+        node);
+  }
+
+  template <typename Make>
+  Shared intern(const Key &key, Type type, bool safe, Make &&make) {
+    if (!safe)
+      return {arena_.make<expr::Expr>(make()), type, false};
+    auto [found, inserted] = global_.try_emplace(key);
+    if (inserted)
+      found->second = {arena_.make<expr::Expr>(make()), type, true};
+    else
+      ++stats_.shared;
+    return found->second;
+  }
+
+  // 折叠出来的字符串在旧 arena 里，跟着节点复制过来
+  expr::LiteralExpr copied(const expr::LiteralExpr &literal) {
+    auto str = std::get_if<token::StringLiteral>(&literal.value);
+    if (str == nullptr || !from_.owns(str->raw().data()))
+      return literal;
+    return expr::LiteralExpr(token::StringLiteral(
+        arena_.copy_string(str->raw()), str->escaped()));
+  }
+
+  // 字面量的值压成 64 位；字符串换成编号
+  std::uint64_t bits(const Constant &value) {
+    return std::visit(
+        [this](const auto &literal) -> std::uint64_t {
+          using T = std::decay_t<decltype(literal)>;
+          if constexpr (std::is_same_v<T, double>) {
+            return std::bit_cast<std::uint64_t>(literal);
+          } else if constexpr (std::is_same_v<T, std::int64_t> ||
+                               std::is_same_v<T, bool>) {
+            return static_cast<std::uint64_t>(literal);
+          } else if constexpr (std::is_same_v<T, char>) {
+            return static_cast<unsigned char>(literal);
+          } else if constexpr (std::is_same_v<T, token::StringLiteral>) {
+            // 原文相同的字面量才合并，转义与否是原文的一部分
+            std::string raw(literal.escaped() ? "\\" : "\"");
+            raw += literal.raw();
+            return strings_.try_emplace(std::move(raw), strings_.size())
+                .first->second;
+          } else {
+            return 0;  // nil
+          }
+        },
+        value);
+  }
+
+private:
+  ShareStats &stats_;
+  const ast::AstArena &from_;
+  ast::AstArena &arena_;
+  // 跨语句共用的、不会报错的子树
+  std::unordered_map<Key, Shared, KeyHash> global_;
+  std::unordered_map<std::string, std::uint64_t> strings_;
+  // 当前语句的编号
+  std::unordered_map<const expr::Expr *, std::uint32_t> ids_;
+  std::unordered_map<Key, std::uint32_t, KeyHash> local_;
+  std::unordered_map<symbol::SymbolId, std::uint32_t> epochs_;
+  std::unordered_map<std::uint32_t, std::size_t> uses_;
+};
+
+}  // namespace
+
+FoldStats fold_constants(ast::Program &program) {
+  FoldStats stats;
+  Folder folder(stats, program.arena());
+  for (stmt::Stmt *statement : program)
+    folder.fold(*statement);
+  return stats;
+}
+
+FoldStats fold_constants(stmt::Stmt &statement, ast::AstArena &arena) {
+  FoldStats stats;
+  Folder folder(stats, arena);
+  folder.fold(statement);
+  return stats;
+}
+
+FoldStats fold_constants(expr::Expr *&expr, ast::AstArena &arena) {
+  FoldStats stats;
+  Folder folder(stats, arena);
+  folder.fold(expr);
+  return stats;
+}
+
+ShareStats share_subexpressions(ast::Program &program) {
+  ShareStats stats;
+  auto arena = std::make_unique<ast::AstArena>();
+  Sharer sharer(stats, program.arena(), *arena);
+  std::vector<stmt::Stmt *> statements;
+  statements.reserve(program.size());
+  for (const stmt::Stmt *statement : program)
+    statements.push_back(sharer.copy(*statement));
+  // 旧的 arena 在这里整个释放
+  program = ast::Program(std::move(arena), std::move(statements),
+                         program.shifts());
+  return stats;
+}
+
+}  // namespace optimizer
+}  // namespace dtoy
@@ -1,7 +1,10 @@
 #include "parser.h"
 
-#include <memory>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <stdexcept>
+#include <variant>
 
 #include "expr.h"
 #include "stmt.h"
@@ -11,103 +14,120 @@ namespace dtoy {
 namespace parser {
 using namespace dtoy::expr;
 using namespace dtoy::stmt;
-std::unique_ptr<Expr> Parser::expression() { return assignment(); }
-std::unique_ptr<Expr> Parser::assignment() {
-  std::unique_ptr<Expr> expr = equality();
-  if (match({token::TokenType::EQUAL})) {
-    token::Token equals = previous();
-    std::unique_ptr<Expr> value = assignment();
+namespace {
+
+// 中缀运算符的结合力。left 和当前允许的最低结合力比较，决定运算符能不能
+// 接在左边的表达式后面；right 是解析右操作数时的最低结合力。
+// left < right 为左结合，left > right 为右结合（赋值）；left == 0 不是中缀运算符。
+// 新的二元运算符只需要在这里加一项
+struct BindingPower {
+  std::uint8_t left = 0;
+  std::uint8_t right = 0;
+};
+
+constexpr std::array<BindingPower, token::kTokenTypeCount> kInfix = [] {
+  std::array<BindingPower, token::kTokenTypeCount> table{};
+  auto set = [&table](token::TokenType type, std::uint8_t left,
+                      std::uint8_t right) {
+    table[static_cast<std::size_t>(type)] = {left, right};
+  };
+  set(token::TokenType::EQUAL, 2, 1);
+  set(token::TokenType::BANG_EQUAL, 3, 4);
+  set(token::TokenType::EQUAL_EQUAL, 3, 4);
+  set(token::TokenType::GREATER, 5, 6);
+  set(token::TokenType::GREATER_EQUAL, 5, 6);
+  set(token::TokenType::LESS, 5, 6);
+  set(token::TokenType::LESS_EQUAL, 5, 6);
+  set(token::TokenType::MINUS, 7, 8);
+  set(token::TokenType::PLUS, 7, 8);
+  set(token::TokenType::SLASH, 9, 10);
+  set(token::TokenType::STAR, 9, 10);
+  return table;
+}();
+
+// 前缀 ! 和 - 的操作数的最低结合力，比所有中缀运算符都高
+constexpr std::uint8_t kPrefix = 11;
+
+constexpr BindingPower infix(token::TokenType type) {
+  return kInfix[static_cast<std::size_t>(type)];
+}
+
+}  // namespace
+
+Expr *Parser::expression() { return expression(0); }
+
+// Pratt 解析：先读一个前缀表达式，再不断吸收结合力不低于 min_power 的
+// 中缀运算符
+Expr *Parser::expression(std::uint8_t min_power) {
+  Expr *expr = nullptr;
+  token::TokenType type = peekType();
+  if (type == token::TokenType::BANG || type == token::TokenType::MINUS) {
+    advance();
+    token::TokenView op = previousView();
+    expr = arena_->make<Expr>(UnaryExpr(op, expression(kPrefix)));
+  } else {
+    expr = primary();
+  }
+
+  while (true) {
+    // EOF_ 和其他非运算符的结合力都是 0
+    BindingPower power = infix(peekType());
+    if (power.left == 0 || power.left < min_power)
+      break;
+    advance();
+    token::TokenView op = previousView();
+    Expr *right = expression(power.right);
+    if (op.type() != token::TokenType::EQUAL) {
+      expr = arena_->make<Expr>(BinaryExpr(expr, op, right));
+      continue;
+    }
     if (auto varExpr = std::get_if<VariableExpr>(&(*expr))) {
-      token::Token name = varExpr->name;
-      return std::make_unique<Expr>(
-          AssignExpr(name, std::move(value)));
+      expr = arena_->make<Expr>(AssignExpr(varExpr->name, right));
+      continue;
     }
-    throw std::runtime_error("line: " + std::to_string(equals.line()) +
-                             " lexeme:" + equals.lexeme() +
+    throw std::runtime_error(where(op) +
+                             " lexeme:" + std::string(op.lexeme()) +
                              " Invalid assignment target.");
   }
   return expr;
 }
-std::unique_ptr<Expr> Parser::equality() {
-  std::unique_ptr<Expr> expr = comparison();
-  while (match({token::TokenType::BANG_EQUAL, token::TokenType::EQUAL_EQUAL})) {
-    token::Token op = previous();
-    std::unique_ptr<Expr> right = comparison();
-    expr = std::make_unique<Expr>(
-        BinaryExpr(std::move(expr), op, std::move(right)));
-  }
-  return expr;
-}
-std::unique_ptr<Expr> Parser::comparison() {
-  std::unique_ptr<Expr> expr = term();
-  while (match({token::TokenType::GREATER, token::TokenType::GREATER_EQUAL,
-                token::TokenType::LESS, token::TokenType::LESS_EQUAL})) {
-    token::Token op = previous();
-    std::unique_ptr<Expr> right = term();
-    expr = std::make_unique<Expr>(
-        BinaryExpr(std::move(expr), op, std::move(right)));
-  }
-  return expr;
-}
-std::unique_ptr<Expr> Parser::term() {
-  std::unique_ptr<Expr> expr = factor();
-  while (match({token::TokenType::MINUS, token::TokenType::PLUS})) {
-    token::Token op = previous();
-    std::unique_ptr<Expr> right = factor();
-    expr = std::make_unique<Expr>(
-        BinaryExpr(std::move(expr), op, std::move(right)));
-  }
-  return expr;
-}
-std::unique_ptr<Expr> Parser::factor() {
-  std::unique_ptr<Expr> expr = unary();
-  while (match({token::TokenType::SLASH, token::TokenType::STAR})) {
-    token::Token op = previous();
-    std::unique_ptr<Expr> right = unary();
-    expr = std::make_unique<Expr>(
-        BinaryExpr(std::move(expr), op, std::move(right)));
-  }
-  return expr;
-}
-std::unique_ptr<Expr> Parser::unary() {
-  while (match({token::TokenType::BANG, token::TokenType::MINUS})) {
-    token::Token op = previous();
-    std::unique_ptr<Expr> right = unary();
-    return std::make_unique<Expr>(UnaryExpr(op, std::move(right)));
-  }
-  return primary();
-}
-std::unique_ptr<Expr> Parser::primary() {
+Expr *Parser::primary() {
   if (match({token::TokenType::FALSE})) {
-    return std::make_unique<Expr>(LiteralExpr(previous().literal()));
+    return arena_->make<Expr>(LiteralExpr(token::constant_of(previousLiteral(), *arena_)));
   } else if (match({token::TokenType::TRUE})) {
-    return std::make_unique<Expr>(LiteralExpr(previous().literal()));
+    return arena_->make<Expr>(LiteralExpr(token::constant_of(previousLiteral(), *arena_)));
   } else if (match({token::TokenType::NIL})) {
-    return std::make_unique<Expr>(LiteralExpr(previous().literal()));
+    return arena_->make<Expr>(LiteralExpr(token::constant_of(previousLiteral(), *arena_)));
   }
   if (match({token::TokenType::NUMBER, token::TokenType::STRING})) {
-    return std::make_unique<Expr>(LiteralExpr(previous().literal()));
+    token::Constant value = token::constant_of(previousLiteral(), *arena_);
+    if (auto str = std::get_if<token::StringLiteral>(&value);
+        str != nullptr && copy_strings_)
+      *str = token::StringLiteral(arena_->copy_string(str->raw()),
+                                  str->escaped());
+    return arena_->make<Expr>(LiteralExpr(value));
   }
   if (match({token::TokenType::IDENTIFIER})) {
-    return std::make_unique<Expr>(VariableExpr(previous()));
+    return arena_->make<Expr>(VariableExpr(previousView()));
   }
   if (match({token::TokenType::LEFT_PAREN})) {
-    std::unique_ptr<Expr> expr = expression();
+    Expr *expr = expression();
     if (!match({token::TokenType::RIGHT_PAREN})) {
       throw std::runtime_error("Expect ')' after expression.");
     }
     // 这里需要创建 GroupingExpr，而不是直接返回 expr
-    return std::make_unique<Expr>(GroupingExpr(std::move(expr)));
+    return arena_->make<Expr>(GroupingExpr(expr));
   }
   if (check(token::TokenType::RIGHT_PAREN)) {
-    throw std::runtime_error("line: " + std::to_string(peek().line()) +
-                             " lexeme:" + peek().lexeme() +
+    throw std::runtime_error(where(peek()) +
+                             " lexeme:" + std::string(peek().lexeme()) +
                              " Unexpected ')' while parsing expression.");
   }
 
   // 如果没有匹配任何primary表达式，抛出错误
-  throw std::runtime_error("line: " + std::to_string(peek().line()) +
-                           "lexeme:" + peek().lexeme() + "Expect expression.");
+  throw std::runtime_error(where(peek()) +
+                           "lexeme:" + std::string(peek().lexeme()) +
+                           "Expect expression.");
 }
 
 bool Parser::match(std::initializer_list<token::TokenType> types) {
@@ -120,60 +140,111 @@ bool Parser::match(std::initializer_list<token::TokenType> types) {
   return false;
 }
 bool Parser::check(token::TokenType type) {
-  return !isAtEnd() && peek().type() == type;
+  return !isAtEnd() && peekType() == type;
 }
-token::Token Parser::advance() {
+void Parser::advance() {
   if (!isAtEnd())
     current_++;
-  return previous();
 }
-bool Parser::isAtEnd() {
+bool Parser::isAtEnd() { return peekType() == token::TokenType::EOF_; }
+token::TokenType Parser::peekType() {
+  if (stream_ != nullptr) {
+    if (current_ >= stream_end_)
+      return token::TokenType::EOF_;
+    return cursor_.type(current_);
+  }
+  fill();
   if (current_ >= tokens_.size())
-    return true;
-  return tokens_[current_].type() == token::TokenType::EOF_;
+    return token::TokenType::EOF_;
+  return tokens_[current_].type();
+}
+const token::Token &Parser::peek() {
+  if (stream_ != nullptr)
+    return scratch_.emplace(cursor_.at(current_));
+  fill();
+  return tokens_[current_];
+}
+const token::Token &Parser::previous() {
+  if (stream_ != nullptr)
+    return scratch_.emplace(cursor_.at(current_ - 1));
+  return tokens_[current_ - 1];
+}
+token::TokenView Parser::previousView() {
+  std::size_t index = current_ - 1;
+  if (stream_ != nullptr)
+    return token::TokenView(cursor_.type(index), cursor_.lexeme(index),
+                            cursor_.offset(index), cursor_.symbol(index));
+  return tokens_[index];
+}
+token::Literal Parser::previousLiteral() {
+  if (stream_ != nullptr)
+    return cursor_.literal(current_ - 1);
+  return tokens_[current_ - 1].literal();
+}
+
+std::string Parser::where(const token::TokenView &token) const {
+  // 行列号只在报错时才从 source 的换行表里查
+  if (source_ == nullptr)
+    return "offset: " + std::to_string(token.offset());
+  source::Location location = source_->locate(token.offset());
+  return "line: " + std::to_string(location.line) +
+         " column: " + std::to_string(location.column);
 }
-token::Token Parser::peek() { return tokens_[current_]; }
-token::Token Parser::previous() { return tokens_[current_ - 1]; }
 
-std::unique_ptr<Stmt> Parser::statement() {
+void Parser::fill() {
+  if (scanner_ == nullptr || current_ < tokens_.size())
+    return;
+  // 只留下 previous() 需要的那一个，窗口大小有上限
+  if (current_ >= kStreamWindow) {
+    window_.erase(window_.begin(), window_.begin() + (current_ - 1));
+    current_ = 1;
+  }
+  window_.push_back(scanner_->next_token());
+  tokens_ = window_;
+}
+
+Stmt *Parser::statement() {
   if (match({token::TokenType::PRINT})) {
     return printStatement();
   }
   return exprStatement();
 }
 
-std::unique_ptr<Stmt> Parser::printStatement() {
-  std::unique_ptr<Expr> value = expression();
+Stmt *Parser::printStatement() {
+  Expr *value = expression();
   if (!match({token::TokenType::SEMICOLON})) {
     throw std::runtime_error("Expect ';' after value.");
   }
-  return std::make_unique<Stmt>(PrintStmt(std::move(value)));
+  return arena_->make<Stmt>(PrintStmt(value));
 }
 
-std::unique_ptr<Stmt> Parser::exprStatement() {
-  std::unique_ptr<Expr> expr = expression();
+Stmt *Parser::exprStatement() {
+  Expr *expr = expression();
   if (!match({token::TokenType::SEMICOLON})) {
     throw std::runtime_error("Expect ';' after expression.");
   }
-  return std::make_unique<Stmt>(ExpressionStmt(std::move(expr)));
+  return arena_->make<Stmt>(ExpressionStmt(expr));
 }
 
-std::unique_ptr<Stmt> Parser::declaration() {
+Stmt *Parser::declaration() {
   if (match({token::TokenType::VAR})) {
     return varDeclaration();
   }
   return statement();
 }
-std::unique_ptr<Stmt> Parser::varDeclaration() {
-  token::Token name = previous();
-  std::unique_ptr<Expr> initializer = nullptr;
+Stmt *Parser::varDeclaration() {
+  if (!match({token::TokenType::IDENTIFIER})) {
+    throw std::runtime_error("Expect variable name.");
+  }
+  token::TokenView name = previousView();
+  Expr *initializer = nullptr;
   if (match({token::TokenType::EQUAL})) {
     initializer = expression();
   }
   if (!match({token::TokenType::SEMICOLON})) {
     throw std::runtime_error("Expect ';' after variable declaration.");
   }
-  return std::make_unique<Stmt>(VarStmt(name, std::move(initializer)));
+  return arena_->make<Stmt>(VarStmt(name, initializer));
 }
 
 } // namespace parser
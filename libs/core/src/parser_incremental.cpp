@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "parser.h"
+#include "source.h"
+#include "token.h"
+
+// 增量解析：
+// 1. Scanner::relex() 给出重新扫描的 token 段，之前的 token 不变，之后的
+//    token 是旧 token 平移过来的；
+// 2. 从第一条碰到重扫 token 的语句开始重新解析，过了重扫段之后，一旦新的
+//    语句边界对应到旧的语句边界就停下，后面的语句都沿用；
+// 3. 重新解析出来、和旧语句 token 完全一样的语句也换回旧节点，报告的
+//    改动只包括真正变了的语句；
+// 4. 沿用的语句不改节点：Document 的字符串字面量复制在 arena 里，不指向
+//    source；编辑之后的语句只在 Program 里把平移量（Program::shift()）
+//    加上字节差，每条 O(1)，不用遍历节点。
+// 5. 只有 previous 拿着 source 时，文本用 SourceBuffer::Rewrite 原地改写，
+//    只挪动编辑点之后的字节；出错时把文本改回去。
+// 语句总是在 ';' 处结束，所以从旧的语句边界开始解析和完整解析的结果相同。
+
+namespace dtoy {
+namespace parser {
+namespace {
+
+// 编辑之前的文本。旧 source 可能已经被原地改写（见 SourceBuffer::Rewrite），
+// 所以从新文本还原：编辑区之外和新文本相同，编辑区是被删掉的原文
+class OldText {
+public:
+  OldText(std::string_view now, const scanner::Scanner::Edit &edit,
+          std::string removed)
+      : now_(now), tail_(now.substr(edit.offset + edit.inserted.size())),
+        offset_(edit.offset), removed_(std::move(removed)) {}
+
+  // 旧文本从 position 开始是不是 text
+  bool matches(std::size_t position, std::string_view text) const {
+    const std::size_t end = position + text.size();
+    const std::size_t edit_end = offset_ + removed_.size();
+    // 旧文本的 [from, to) 对应 source 从 from - base 开始的一段
+    auto part = [&](std::size_t from, std::size_t to, std::string_view source,
+                    std::size_t base) {
+      from = std::max(from, position);
+      to = std::min(to, end);
+      return from >= to || text.substr(from - position, to - from) ==
+                               source.substr(from - base, to - from);
+    };
+    return part(0, offset_, now_, 0) &&
+           part(offset_, edit_end, removed_, offset_) &&
+           part(edit_end, end, tail_, edit_end);
+  }
+
+private:
+  std::string_view now_;
+  std::string_view tail_;  // 编辑区之后的新文本
+  std::size_t offset_;
+  std::string removed_;
+};
+
+// 两段 token 是否逐个相同；新 token 的 offset 比旧的多 shift
+bool same_tokens(const token::TokenStream &now, std::size_t begin,
+                 std::size_t end, const token::TokenStream &before,
+                 std::size_t old_begin, std::size_t old_end,
+                 std::ptrdiff_t shift, const OldText &old_text) {
+  if (end - begin != old_end - old_begin)
+    return false;
+  token::TokenStream::Cursor current(now);
+  token::TokenStream::Cursor previous(before);
+  for (std::size_t i = begin, j = old_begin; i < end; ++i, ++j) {
+    if (current.type(i) != previous.type(j) ||
+        current.offset(i) != previous.offset(j) + shift ||
+        current.length(i) != previous.length(j) ||
+        !old_text.matches(previous.offset(j), current.lexeme(i)))
+      return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+Parser::Document Parser::parse_document(token::TokenStream tokens) {
+  Document document;
+  Parser parser(tokens);
+  parser.copy_strings_ = true;
+  std::vector<Stmt *> statements;
+  while (!parser.isAtEnd()) {
+    statements.push_back(parser.declaration());
+    document.ends.push_back(parser.current_);
+  }
+  // Program 不引用 token，stream 可以在解析之后移走
+  document.program =
+      ast::Program(std::move(parser.arena_), std::move(statements));
+  document.tokens = std::move(tokens);
+  return document;
+}
+
+Parser::ReparseResult Parser::reparse(Document &&previous,
+                                      const scanner::Scanner::Edit &edit) {
+  const token::TokenStream &before = previous.tokens;
+  const std::vector<std::size_t> &ends = previous.ends;
+  std::string removed_text(
+      before.source()->slice(edit.offset, edit.removed));
+  // 只有 previous 拿着 source 时原地改写，出错时改回去
+  source::SourceBuffer::Rewrite text(before.source(), edit.offset,
+                                     edit.removed, edit.inserted);
+  scanner::Scanner::RelexResult relex =
+      scanner::Scanner::relex(before, edit, text.result());
+  const token::TokenStream &now = relex.tokens;
+  const OldText old_text(now.source()->view(), edit, std::move(removed_text));
+
+  // 重扫段之后，新旧 token 下标和字节位置的差
+  const std::ptrdiff_t token_shift =
+      static_cast<std::ptrdiff_t>(now.size()) -
+      static_cast<std::ptrdiff_t>(before.size());
+  const std::ptrdiff_t byte_shift =
+      static_cast<std::ptrdiff_t>(edit.inserted.size()) -
+      static_cast<std::ptrdiff_t>(edit.removed);
+  const std::size_t relexed_end = relex.first + relex.relexed;
+  auto old_begin = [&ends](std::size_t statement) {
+    return statement == 0 ? 0 : ends[statement - 1];
+  };
+
+  // token 全在重扫段之前的语句不受影响
+  std::size_t first = static_cast<std::size_t>(
+      std::upper_bound(ends.begin(), ends.end(), relex.first) - ends.begin());
+  std::size_t resume = ends.size();  // 从这条旧语句开始沿用
+
+  Parser parser(now);
+  parser.copy_strings_ = true;
+  parser.current_ = old_begin(first);
+  std::vector<Stmt *> inserted;
+  std::vector<std::size_t> inserted_ends;
+  while (true) {
+    std::size_t position = parser.current_;
+    if (position >= relexed_end) {
+      // 这里之后的 token 都是旧 token 平移过来的
+      std::size_t old_position = position - token_shift;
+      auto found = std::lower_bound(ends.begin() + first, ends.end(),
+                                    old_position);
+      if (old_position == old_begin(first)) {
+        resume = first;
+        break;
+      }
+      if (found != ends.end() && *found == old_position) {
+        resume = static_cast<std::size_t>(found - ends.begin()) + 1;
+        break;
+      }
+    }
+    if (parser.isAtEnd())
+      break;
+    inserted.push_back(parser.declaration());
+    inserted_ends.push_back(parser.current_);
+  }
+
+  // 两头重新解析出来但 token 没变的语句换回旧节点
+  std::size_t keep_front = 0;
+  while (keep_front < inserted.size() && first + keep_front < resume) {
+    std::size_t old = first + keep_front;
+    std::size_t begin = keep_front == 0 ? old_begin(first)
+                                        : inserted_ends[keep_front - 1];
+    if (!same_tokens(now, begin, inserted_ends[keep_front], before,
+                     old_begin(old), ends[old], 0, old_text))
+      break;
+    ++keep_front;
+  }
+  std::size_t keep_back = 0;
+  while (keep_front + keep_back < inserted.size() &&
+         first + keep_front < resume - keep_back) {
+    std::size_t index = inserted.size() - 1 - keep_back;
+    std::size_t old = resume - 1 - keep_back;
+    std::size_t begin = index == 0 ? old_begin(first) : inserted_ends[index - 1];
+    if (!same_tokens(now, begin, inserted_ends[index], before, old_begin(old),
+                     ends[old], byte_shift, old_text))
+      break;
+    ++keep_back;
+  }
+
+  // 到这里不会再抛异常，开始改动 previous
+  text.commit();
+  ReparseResult result{Document{}, first + keep_front,
+                       resume - keep_back - first - keep_front,
+                       inserted.size() - keep_back - keep_front};
+  const std::size_t tail = resume - keep_back;  // 旧语句从这里开始平移
+  const ast::Program &program = previous.program;
+  std::vector<Stmt *> statements;
+  std::vector<std::size_t> new_ends;
+  std::vector<std::ptrdiff_t> shifts;
+  statements.reserve(ends.size() - result.removed + result.inserted);
+  new_ends.reserve(statements.capacity());
+  shifts.reserve(statements.capacity());
+  // 编辑之前的语句不用动
+  statements.assign(program.begin(), program.begin() + result.first);
+  new_ends.assign(ends.begin(), ends.begin() + result.first);
+  for (std::size_t i = 0; i < result.first; ++i)
+    shifts.push_back(program.shift(i));
+  for (std::size_t i = keep_front; i < inserted.size() - keep_back; ++i) {
+    statements.push_back(inserted[i]);
+    new_ends.push_back(inserted_ends[i]);
+    shifts.push_back(0);
+  }
+  // 编辑之后的语句节点不变，只改平移量
+  for (std::size_t i = tail; i < ends.size(); ++i) {
+    statements.push_back(program[i]);
+    new_ends.push_back(ends[i] + token_shift);
+    shifts.push_back(program.shift(i) + byte_shift);
+  }
+
+  // 换下来的旧语句和换回旧节点的新语句都还在 arena 里
+  parser.arena_->absorb(std::move(previous.program.arena()));
+  Document &document = result.document;
+  document.garbage = previous.garbage + result.removed + keep_front + keep_back;
+  document.ends = std::move(new_ends);
+  document.program = ast::Program(std::move(parser.arena_),
+                                  std::move(statements), std::move(shifts));
+  document.tokens = std::move(relex.tokens);
+  previous = Document{};
+  // 垃圾比活着的语句还多时整个重新解析一次，均摊下来不改变每次编辑的量级
+  if (document.garbage > document.ends.size())
+    document = parse_document(std::move(document.tokens));
+  return result;
+}
+
+}  // namespace parser
+}  // namespace dtoy
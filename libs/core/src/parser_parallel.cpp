@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "parser.h"
+#include "token.h"
+
+// 并行解析：
+// 1. 预扫描只看 token 类型，在目标位置之后找第一个大括号外的 ';'；
+// 2. 每段交给一个只看 [begin, end) 的 Parser，在自己的线程里解析，
+//    节点分配在这个 Parser 自己的 arena 里；
+// 3. 按段的顺序拼接语句，arena 全部并入调用方的 arena。
+// 语句总是在 ';' 处结束，表达式不会越过 ';'，所以从 ';' 之后开始解析
+// 和串行解析走到这里时的状态完全一样，结果逐个节点相同。
+
+namespace dtoy {
+namespace parser {
+namespace {
+
+// 太小的段不值得开线程
+constexpr std::size_t kMinChunkTokens = 64 * 1024;
+
+}  // namespace
+
+Parser::Parser(const Parser &parent, std::size_t begin, std::size_t end)
+    : current_(begin), stream_(parent.stream_), cursor_(parent.cursor_),
+      source_(parent.source_) {
+  if (stream_ != nullptr)
+    stream_end_ = end;
+  else
+    tokens_ = parent.tokens_.first(end);
+}
+
+ast::Program Parser::parse_parallel(unsigned threads) {
+  if (scanner_ != nullptr)
+    return parse();
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t begin = current_;
+  const std::size_t end = stream_ != nullptr ? stream_end_ : tokens_.size();
+  const std::size_t chunks = std::clamp<std::size_t>(
+      (end - begin) / kMinChunkTokens, 1, threads);
+  if (chunks == 1)
+    return parse();
+
+  // 返回 chunks + 1 个切分点（不足时更少），第一个是 begin，最后一个是 end
+  std::vector<std::size_t> splits{begin};
+  std::size_t next = 1;
+  std::size_t depth = 0;
+  auto target = [&](std::size_t index) {
+    return begin + (end - begin) * index / chunks;
+  };
+  for (std::size_t i = begin; i < end && next < chunks; ++i) {
+    token::TokenType type =
+        stream_ != nullptr ? cursor_.type(i) : tokens_[i].type();
+    if (type == token::TokenType::LEFT_BRACE) {
+      ++depth;
+    } else if (type == token::TokenType::RIGHT_BRACE) {
+      depth -= depth > 0;
+    } else if (type == token::TokenType::SEMICOLON && depth == 0 &&
+               i + 1 >= target(next) && i + 1 < end) {
+      splits.push_back(i + 1);
+      while (next < chunks && target(next) <= i + 1)
+        ++next;
+    }
+  }
+  splits.push_back(end);
+  const std::size_t count = splits.size() - 1;
+  if (count == 1)
+    return parse();
+
+  std::vector<Parser> parts;
+  parts.reserve(count);
+  for (std::size_t i = 0; i < count; ++i)
+    parts.push_back(Parser(*this, splits[i], splits[i + 1]));
+
+  std::vector<std::vector<Stmt *>> statements(count);
+  std::vector<std::exception_ptr> errors(count);
+  std::vector<std::thread> workers;
+  workers.reserve(count - 1);
+  auto work = [&](std::size_t i) {
+    try {
+      while (!parts[i].isAtEnd())
+        statements[i].push_back(parts[i].declaration());
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+  for (std::size_t i = 1; i < count; ++i)
+    workers.emplace_back(work, i);
+  work(0);
+  for (auto &worker : workers)
+    worker.join();
+
+  // 每段在自己的第一个错误处停下，最靠前的段的错误就是串行解析会报的那个。
+  // 和 parse() 出错时一样，已经建好的节点留在 parser 的 arena 里
+  for (auto &part : parts)
+    arena_->absorb(std::move(*part.arena_));
+  for (const auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+
+  std::size_t total = 0;
+  for (const auto &part : statements)
+    total += part.size();
+  std::vector<Stmt *> program;
+  program.reserve(total);
+  for (const auto &part : statements)
+    program.insert(program.end(), part.begin(), part.end());
+
+  current_ = parts.back().current_;
+  return ast::Program(std::exchange(arena_, std::make_unique<ast::AstArena>()),
+                      std::move(program));
+}
+
+}  // namespace parser
+}  // namespace dtoy
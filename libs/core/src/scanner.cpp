@@ -1,6 +1,8 @@
 #include "scanner.h"
 
-#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <limits>
 #include <stdexcept>
 #include <string>
 
@@ -10,21 +12,77 @@ namespace dtoy {
 namespace scanner {
 
 std::vector<token::Token> Scanner::scan_tokens() {
+  scan_remaining();
+  tokens_.push_back(eof_token());
+
+  std::vector<token::Token> tokens;
+  tokens.swap(tokens_);
+  return tokens;
+}
+
+token::Token Scanner::next_token() {
+  // tokens_ 在这里只当作单个 token 的暂存区
   while (!is_at_end()) {
+    std::size_t before = tokens_.size();
     scan_token();
+    if (tokens_.size() != before) {
+      token::Token token = std::move(tokens_.back());
+      tokens_.pop_back();
+      return token;
+    }
   }
-  tokens_.emplace_back(token::TokenType::EOF_, "", line_);
-  return tokens_;
+  return eof_token();
+}
+
+token::TokenStream Scanner::scan_token_stream() {
+  token::TokenStream stream(source_);
+  for (const auto &token : tokens_)
+    stream.push_back(token);
+  tokens_.clear();
+  while (!is_at_end()) {
+    scan_token();
+    for (const auto &token : tokens_)
+      stream.push_back(token);
+    tokens_.clear();
+  }
+  stream.push_back(eof_token());
+  stream.shrink_to_fit();
+  return stream;
+}
+
+void Scanner::check_utf8(std::size_t begin, std::size_t end) const {
+  // 一次向量化扫描，纯 ASCII 的块直接跳过
+  const char *base = source_->data();
+  const char *invalid = kernels_->validate_utf8(base + begin, base + end);
+  if (invalid == base + end)
+    return;
+  source::Location location =
+      source_->locate(static_cast<std::size_t>(invalid - base));
+  throw std::runtime_error("Invalid UTF-8 at line " +
+                           std::to_string(location.line) + " column " +
+                           std::to_string(location.column) + ".");
+}
+
+void Scanner::scan_remaining() {
+  while (!is_at_end()) {
+    scan_token();
+  }
+}
+
+token::Token Scanner::eof_token() const {
+  return token::Token(token::TokenType::EOF_, sources_.substr(sources_.size()),
+                      offset_of(sources_.size()));
 }
 
 
 void Scanner::scan_token() {
+  if (mode_ == Mode::Table) {
+    scan_token_table();
+    return;
+  }
   start_ = current_;
   char c = advance();
-  if (std::isspace(c)) {
-    if (c == '\n') {
-      line_++;
-    }
+  if (simd::is_space(c)) {
     skip_whitespace();
     return;
   }
@@ -32,89 +90,49 @@ void Scanner::scan_token() {
   // 处理符号
   switch (c) {
   // 单符号
-  case '(': add_token(token::TokenType::LEFT_PAREN,sources_.substr(start_, current_ - start_)); break;
-  case ')': add_token(token::TokenType::RIGHT_PAREN,sources_.substr(start_, current_ - start_)); break;
-  case '{': add_token(token::TokenType::LEFT_BRACE,sources_.substr(start_, current_ - start_)); break;
-  case '}': add_token(token::TokenType::RIGHT_BRACE,sources_.substr(start_, current_ - start_)); break;
-  case ';': add_token(token::TokenType::SEMICOLON,sources_.substr(start_, current_ - start_)); break;
-  case ',': add_token(token::TokenType::COMMA,sources_.substr(start_, current_ - start_)); break;
-  case '.': add_token(token::TokenType::DOT,sources_.substr(start_, current_ - start_)); break;
-  case '-': add_token(token::TokenType::MINUS,sources_.substr(start_, current_ - start_)); break;
-  case '+': add_token(token::TokenType::PLUS,sources_.substr(start_, current_ - start_)); break;
-  case '/': add_token(token::TokenType::SLASH,sources_.substr(start_, current_ - start_)); break;
-  case '*': add_token(token::TokenType::STAR,sources_.substr(start_, current_ - start_)); break;
+  case '(': add_token(token::TokenType::LEFT_PAREN); break;
+  case ')': add_token(token::TokenType::RIGHT_PAREN); break;
+  case '{': add_token(token::TokenType::LEFT_BRACE); break;
+  case '}': add_token(token::TokenType::RIGHT_BRACE); break;
+  case ';': add_token(token::TokenType::SEMICOLON); break;
+  case ',': add_token(token::TokenType::COMMA); break;
+  case '.': add_token(token::TokenType::DOT); break;
+  case '-': add_token(token::TokenType::MINUS); break;
+  case '+': add_token(token::TokenType::PLUS); break;
+  case '/':
+    if (match('/')) {
+      line_comment();
+    } else {
+      add_token(token::TokenType::SLASH);
+    }
+    break;
+  case '*': add_token(token::TokenType::STAR); break;
 
   // 双符号
   case '!':
     add_token(match('=') ? token::TokenType::BANG_EQUAL
-                         : token::TokenType::BANG,sources_.substr(start_, current_ - start_));
+                         : token::TokenType::BANG);
     break;
 
   case '=':
     add_token(match('=') ? token::TokenType::EQUAL_EQUAL
-                         : token::TokenType::EQUAL,sources_.substr(start_, current_ - start_));
+                         : token::TokenType::EQUAL);
     break;
 
   case '>':
     add_token(match('=') ? token::TokenType::GREATER_EQUAL
-                         : token::TokenType::GREATER,sources_.substr(start_, current_ - start_));
+                         : token::TokenType::GREATER);
     break;
 
   case '<':
     add_token(match('=') ? token::TokenType::LESS_EQUAL
-                         : token::TokenType::LESS,sources_.substr(start_, current_ - start_));
+                         : token::TokenType::LESS);
     break;
 
 
     // 字符串
-  case '"': {
-    std::string literal;
-    std::string lexeme = "\"";
-    while (peek() != '"' && !is_at_end()) {
-      if (peek() == '\\') {
-        lexeme += advance();  // Consume the backslash
-        char escape_char = advance();
-        auto [lexeme_part, actual_char] = process_escape_sequence(escape_char);
-        lexeme += lexeme_part;
-        literal += actual_char;
-      } else {
-        char temp = advance();
-        lexeme += temp;
-        literal += temp;
-      }
-    }
-
-    lexeme += advance();  // consume closing "
-    add_token(token::TokenType::STRING, lexeme, token::Literal{literal});
-    break;
-  }
-
-
-  case '\'': {
-    std::string lexeme = "\'";
-    char literal_char;
-    if (peek() == '\\') {
-      lexeme += advance();  // consume backslash
-      char escape_char = advance();
-      auto [lexeme_part, actual_char] = process_escape_sequence(escape_char);
-
-      lexeme += lexeme_part;
-      literal_char = actual_char;
-    } else {
-      literal_char = advance();
-      lexeme += literal_char;
-    }
-    if (peek() != '\'') {
-      // Handle error: Unterminated char literal
-      throw std::runtime_error("Unterminated char literal." +
-                               std::string(" at line ") +
-                               std::to_string(line_) + " lexeme: " + lexeme);
-    }
-
-    lexeme += advance();  // consume closing '
-    add_token(token::TokenType::CHAR, lexeme, token::Literal{literal_char});
-    break;
-  }
+  case '"': string(); break;
+  case '\'': character(); break;
 
   // EOF_
   case '\0': add_token(token::TokenType::EOF_); break;
@@ -122,9 +140,9 @@ void Scanner::scan_token() {
   default:
 
     // Handle unexpected characters
-    if (std::isalpha(c) || c == '_') {
+    if (simd::is_alpha(c)) {
       identifierAndKeywords();
-    } else if (std::isdigit(c)) {
+    } else if (simd::is_digit(c)) {
       number();
     }
     break;
@@ -132,14 +150,58 @@ void Scanner::scan_token() {
 }
 
 
+void Scanner::string() {
+  // 一次扫到结尾的引号，只记下有没有转义，解码留到取值的时候
+  bool escaped = false;
+  while (true) {
+    skip_with(kernels_->find_string_special);
+    if (peek() != '\\')
+      break;
+    escaped = true;
+    advance();  // Consume the backslash
+    advance();  // 转义字符
+  }
+
+  // 只看一段的 scanner 在这里说明字符串越过了段尾，并行扫描据此重扫
+  if (is_at_end())
+    string_cut_ = true;
+  std::string_view raw = sources_.substr(start_ + 1, current_ - start_ - 1);
+  advance();  // consume closing "
+  add_token(token::TokenType::STRING,
+            token::Literal{token::StringLiteral(raw, escaped)});
+}
+
+void Scanner::character() {
+  char literal_char;
+  if (peek() == '\\') {
+    advance();  // consume backslash
+    char escape_char = advance();
+    literal_char = process_escape_sequence(escape_char);
+  } else {
+    literal_char = advance();
+  }
+  if (peek() != '\'') {
+    // Handle error: Unterminated char literal
+    source::Location location = source_->locate(offset_of(start_));
+    throw std::runtime_error("Unterminated char literal." +
+                             std::string(" at line ") +
+                             std::to_string(location.line) + " column " +
+                             std::to_string(location.column) + " lexeme: " +
+                             std::string(current_lexeme()));
+  }
+
+  advance();  // consume closing '
+  add_token(token::TokenType::CHAR, token::Literal{literal_char});
+}
+
 void Scanner::identifierAndKeywords() {
   // Implementation for scanning identifiers
-  while (std::isalnum(peek()) || peek() == '_') {
-    advance();
-  }
+  skip_with(kernels_->skip_identifier);
+  add_identifier();
+}
 
-  std::string text = sources_.substr(start_, current_ - start_);
-  auto [is_keyword, token_type] = token::Token::isKeyword(text);
+void Scanner::add_identifier() {
+  auto [is_keyword, token_type] = token::Token::isKeyword(current_lexeme());
   if (is_keyword)
     if (token_type == token::TokenType::TRUE)
       add_token(token_type, true);
@@ -150,71 +212,140 @@ void Scanner::identifierAndKeywords() {
     else
       add_token(token_type);
   else
-    add_token(token::TokenType::IDENTIFIER, text);
+    tokens_.push_back(token::Token::identifier(
+        current_lexeme(),
+        symbol::SymbolTable::global().intern(current_lexeme()),
+        offset_of(start_)));
 }
 
 void Scanner::number() {
-  bool is_float = false;
-  // Implementation for scanning numbers
-  while (std::isdigit(peek())) {
-    advance();
+  // 第一个数字已经被 advance() 消费
+  NumberKind kind = NumberKind::Integer;
+  bool leading_zero = sources_[start_] == '0';
+  if (leading_zero && (peek() == 'x' || peek() == 'X') &&
+      simd::is_hex_digit(peek_next())) {
+    advance();  // Consume the "x"
+    kind = NumberKind::Hex;
+    digit_run(16);
+  } else if (leading_zero && (peek() == 'b' || peek() == 'B') &&
+             (peek_next() == '0' || peek_next() == '1')) {
+    advance();  // Consume the "b"
+    kind = NumberKind::Binary;
+    digit_run(2);
+  } else {
+    digit_run(10);
+    // Look for a fractional part.
+    if (peek() == '.' && simd::is_digit(peek_next())) {
+      kind = NumberKind::Float;
+      advance();  // Consume the "."
+      digit_run(10);
+    }
   }
+  add_number(kind);
+}
+
+namespace {
 
-  // Look for a fractional part.
-  if (peek() == '.' && std::isdigit(peek_next())) {
-    is_float = true;
-    // Consume the "."
-    advance();
+bool is_base_digit(char c, int base) {
+  switch (base) {
+  case 2: return c == '0' || c == '1';
+  case 16: return simd::is_hex_digit(c);
+  default: return simd::is_digit(c);
+  }
+}
 
+int digit_value(char c) {
+  if (simd::is_digit(c))
+    return c - '0';
+  return (c | 0x20) - 'a' + 10;
+}
 
-    while (std::isdigit(peek())) {
-      advance();
+// 超出 int64 的整数字面量按 double 处理
+double to_double(std::string_view digits, int base) {
+  if (base == 10) {
+    double value = 0;
+    auto [ptr, ec] = std::from_chars(digits.data(),
+                                     digits.data() + digits.size(), value);
+    if (ec == std::errc::result_out_of_range)
+      return std::numeric_limits<double>::infinity();
+    return value;
+  }
+  double value = 0;
+  for (char c : digits)
+    value = value * base + digit_value(c);
+  return value;
+}
+
+}  // namespace
+
+void Scanner::digit_run(int base) {
+  // 数字之间可以有单个 '_' 分隔（1_000_000）；
+  // '_' 后面不是数字时不属于这个数字，留给下一个 token
+  while (true) {
+    if (base == 10) {
+      skip_with(kernels_->skip_digits);
+    } else {
+      while (is_base_digit(peek(), base))
+        advance();
     }
+    if (peek() != '_' || !is_base_digit(peek_next(), base))
+      return;
+    advance();  // Consume the "_"
   }
+}
 
-  std::string number_str = sources_.substr(start_, current_ - start_);
-  if(is_float){
-    double value = std::stod(number_str);
-    add_token(token::TokenType::NUMBER, number_str, token::Literal{value});
+void Scanner::add_number(NumberKind kind) {
+  std::string_view digits = current_lexeme();
+  int base = 10;
+  if (kind == NumberKind::Hex || kind == NumberKind::Binary) {
+    digits.remove_prefix(2);
+    base = kind == NumberKind::Hex ? 16 : 2;
+  }
+
+  // 只有带分隔符的数字才需要拷贝，其余直接从 source buffer 解析
+  std::string stripped;
+  if (digits.find('_') != std::string_view::npos) {
+    stripped.reserve(digits.size());
+    for (char c : digits)
+      if (c != '_')
+        stripped += c;
+    digits = stripped;
+  }
+
+  if (kind == NumberKind::Float) {
+    add_token(token::TokenType::NUMBER, token::Literal{to_double(digits, 10)});
     return;
   }
-  else{
-    int value = std::stoi(number_str);
-    add_token(token::TokenType::NUMBER, number_str, token::Literal{value});
+
+  std::int64_t value = 0;
+  auto [ptr, ec] = std::from_chars(digits.data(),
+                                   digits.data() + digits.size(), value, base);
+  if (ec == std::errc::result_out_of_range) {
+    add_token(token::TokenType::NUMBER,
+              token::Literal{to_double(digits, base)});
     return;
   }
+  add_token(token::TokenType::NUMBER, token::Literal{value});
 }
 
 
 void Scanner::add_token(token::TokenType type) {
-  add_token(type, std::string(""));
-}
-
-void Scanner::add_token(token::TokenType type, std::string lexeme) {
-  add_token(type, lexeme, token::Literal{});
+  // 没有字面量的 token 用 monostate；Literal{} 会是一个空 std::string
+  add_token(type, token::Literal{std::monostate{}});
 }
 
 void Scanner::add_token(token::TokenType type, token::Literal literal) {
-  add_token(type, sources_.substr(start_, current_ - start_), literal);
-}
-
-void Scanner::add_token(token::TokenType type, std::string lexeme,
-                        token::Literal literal) {
-  tokens_.emplace_back(type, lexeme, literal, line_);
+  tokens_.emplace_back(type, current_lexeme(), std::move(literal),
+                       offset_of(start_));
 }
 
-inline char Scanner::advance() {
-  if (is_at_end())
-    return '\0';
-  return sources_[current_++];
+std::string_view Scanner::current_lexeme() const {
+  return sources_.substr(start_, current_ - start_);
 }
 
 const std::vector<token::Token> &Scanner::show_tokens() const {
   return tokens_;
 }
-bool Scanner::is_at_end() const {
-  return current_ >= sources_.length();
-}
 
 bool Scanner::match(char expected) {
   if (is_at_end())
@@ -227,18 +358,13 @@ bool Scanner::match(char expected) {
 }
 
 void Scanner::skip_whitespace() {
-  // Implementation for skipping whitespace (if needed)
-  char c = advance();
+  // 批量跳过空白，停在第一个非空白字符上；换行不在这里计数
+  skip_with(kernels_->skip_whitespace);
+}
 
-  while (std::isspace(c)) {
-    if (c == '\n') {
-      line_++;
-    }
-    if (is_at_end())
-      break;
-    c = advance();
-  }
-  current_--;  // Step back one character since we've advanced one too far
+void Scanner::line_comment() {
+  // "//" 到行尾都是注释，换行符留给 skip_whitespace
+  skip_with(kernels_->find_newline);
 }
 
 char Scanner::peek() const {
@@ -254,45 +380,8 @@ char Scanner::peek_next() const {
 }
 
 
-std::pair<char, char> Scanner::process_escape_sequence(char escape_char) {
-  char lexeme_part;
-  char actual_char;
-  switch (escape_char) {
-  case 'n':
-    lexeme_part = escape_char;
-    actual_char = '\n';
-    break;
-  case 't':
-    lexeme_part = escape_char;
-    actual_char = '\t';
-    break;
-  case 'r':
-    lexeme_part = escape_char;
-    actual_char = '\r';
-    break;
-  case '0':
-    lexeme_part = escape_char;
-    actual_char = '\0';
-    break;
-  case '\'':
-    lexeme_part = escape_char;
-    actual_char = '\'';
-    break;
-  case '"':
-    lexeme_part = escape_char;
-    actual_char = '"';
-    break;
-  case '\\':
-    lexeme_part = escape_char;
-    actual_char = '\\';
-    break;
-  default:
-    lexeme_part = escape_char;
-    lexeme_part += escape_char;
-    actual_char = escape_char;
-    break;
-  }
-  return {lexeme_part, actual_char};
+char Scanner::process_escape_sequence(char escape_char) {
+  return token::unescape(escape_char);
 }
 
 
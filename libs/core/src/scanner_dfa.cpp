@@ -0,0 +1,246 @@
+#include <array>
+#include <cstdint>
+
+#include "scanner.h"
+#include "token.h"
+
+// 查表驱动的扫描模式 (Scanner::Mode::Table)。
+// 运算符、标识符、空白和注释开头都由同一张 DFA 识别：
+// kNext[state][byte] 直接给出下一个状态，每个字节只做一次查表，
+// 最长匹配靠记录最后一个接受状态来回退。
+// 字符串和字符字面量识别出开头引号后交给 string() / character()，
+// 数字识别出第一个数字后交给 number()（十六进制、二进制、'_' 分隔符
+// 和小数的规则只维护一份）。
+
+namespace dtoy {
+namespace scanner {
+namespace {
+
+using token::TokenType;
+
+// 字符类
+enum CharKind : std::uint8_t {
+  kOther,
+  kNul,
+  kBlank,
+  kAlphaKind,
+  kDigitKind,
+  kDotKind,
+  kQuoteKind,
+  kAposKind,
+  kSlashKind,
+  kEqualKind,
+  kBangKind,
+  kLessKind,
+  kGreaterKind,
+  kLeftParenKind,
+  kRightParenKind,
+  kLeftBraceKind,
+  kRightBraceKind,
+  kCommaKind,
+  kMinusKind,
+  kPlusKind,
+  kSemicolonKind,
+  kStarKind,
+  kCharKindCount,
+};
+
+constexpr std::array<std::uint8_t, 256> make_char_kinds() {
+  std::array<std::uint8_t, 256> kinds{};
+  for (int c = 0; c < 256; ++c) {
+    if (simd::is_space(static_cast<char>(c)))
+      kinds[c] = kBlank;
+    else if (simd::is_alpha(static_cast<char>(c)))
+      kinds[c] = kAlphaKind;
+    else if (simd::is_digit(static_cast<char>(c)))
+      kinds[c] = kDigitKind;
+  }
+  kinds['\0'] = kNul;
+  kinds['.'] = kDotKind;
+  kinds['"'] = kQuoteKind;
+  kinds['\''] = kAposKind;
+  kinds['/'] = kSlashKind;
+  kinds['='] = kEqualKind;
+  kinds['!'] = kBangKind;
+  kinds['<'] = kLessKind;
+  kinds['>'] = kGreaterKind;
+  kinds['('] = kLeftParenKind;
+  kinds[')'] = kRightParenKind;
+  kinds['{'] = kLeftBraceKind;
+  kinds['}'] = kRightBraceKind;
+  kinds[','] = kCommaKind;
+  kinds['-'] = kMinusKind;
+  kinds['+'] = kPlusKind;
+  kinds[';'] = kSemicolonKind;
+  kinds['*'] = kStarKind;
+  return kinds;
+}
+
+// DFA 状态；kError 之后不再前进
+enum State : std::uint8_t {
+  kError,
+  kStart,
+  kSpace,
+  kComment,
+  kIdent,
+  kNumber,
+  kQuote,
+  kApos,
+  kEof,
+  kLeftParen,
+  kRightParen,
+  kLeftBrace,
+  kRightBrace,
+  kComma,
+  kDot,
+  kMinus,
+  kPlus,
+  kSemicolon,
+  kSlash,
+  kStar,
+  kBang,
+  kBangEqual,
+  kEqual,
+  kEqualEqual,
+  kGreater,
+  kGreaterEqual,
+  kLess,
+  kLessEqual,
+  kStateCount,
+};
+
+using KindTable = std::array<std::array<std::uint8_t, kCharKindCount>, kStateCount>;
+
+constexpr KindTable make_kind_transitions() {
+  KindTable t{};  // 默认全部转到 kError
+  auto &start = t[kStart];
+  start[kNul] = kEof;
+  start[kBlank] = kSpace;
+  start[kAlphaKind] = kIdent;
+  start[kDigitKind] = kNumber;
+  start[kDotKind] = kDot;
+  start[kQuoteKind] = kQuote;
+  start[kAposKind] = kApos;
+  start[kSlashKind] = kSlash;
+  start[kEqualKind] = kEqual;
+  start[kBangKind] = kBang;
+  start[kLessKind] = kLess;
+  start[kGreaterKind] = kGreater;
+  start[kLeftParenKind] = kLeftParen;
+  start[kRightParenKind] = kRightParen;
+  start[kLeftBraceKind] = kLeftBrace;
+  start[kRightBraceKind] = kRightBrace;
+  start[kCommaKind] = kComma;
+  start[kMinusKind] = kMinus;
+  start[kPlusKind] = kPlus;
+  start[kSemicolonKind] = kSemicolon;
+  start[kStarKind] = kStar;
+
+  t[kSpace][kBlank] = kSpace;
+  t[kIdent][kAlphaKind] = kIdent;
+  t[kIdent][kDigitKind] = kIdent;
+  t[kSlash][kSlashKind] = kComment;
+  t[kBang][kEqualKind] = kBangEqual;
+  t[kEqual][kEqualKind] = kEqualEqual;
+  t[kGreater][kEqualKind] = kGreaterEqual;
+  t[kLess][kEqualKind] = kLessEqual;
+  return t;
+}
+
+// 把字符类展开成按字节索引的转移表，热循环里每个字节只有这一次查表
+using ByteTable = std::array<std::array<std::uint8_t, 256>, kStateCount>;
+
+constexpr ByteTable make_byte_transitions() {
+  constexpr auto kinds = make_char_kinds();
+  constexpr auto by_kind = make_kind_transitions();
+  ByteTable t{};
+  for (int state = 0; state < kStateCount; ++state)
+    for (int c = 0; c < 256; ++c)
+      t[state][c] = by_kind[state][kinds[c]];
+  return t;
+}
+
+constexpr ByteTable kNext = make_byte_transitions();
+
+constexpr std::array<bool, kStateCount> make_accepting() {
+  std::array<bool, kStateCount> accepting{};
+  for (int state = kSpace; state < kStateCount; ++state)
+    accepting[state] = true;
+  return accepting;
+}
+
+constexpr auto kAccepting = make_accepting();
+
+// 运算符状态直接对应的 token 类型
+constexpr std::array<TokenType, kStateCount> make_state_tokens() {
+  std::array<TokenType, kStateCount> types{};
+  types.fill(TokenType::EOF_);
+  types[kLeftParen] = TokenType::LEFT_PAREN;
+  types[kRightParen] = TokenType::RIGHT_PAREN;
+  types[kLeftBrace] = TokenType::LEFT_BRACE;
+  types[kRightBrace] = TokenType::RIGHT_BRACE;
+  types[kComma] = TokenType::COMMA;
+  types[kDot] = TokenType::DOT;
+  types[kMinus] = TokenType::MINUS;
+  types[kPlus] = TokenType::PLUS;
+  types[kSemicolon] = TokenType::SEMICOLON;
+  types[kSlash] = TokenType::SLASH;
+  types[kStar] = TokenType::STAR;
+  types[kBang] = TokenType::BANG;
+  types[kBangEqual] = TokenType::BANG_EQUAL;
+  types[kEqual] = TokenType::EQUAL;
+  types[kEqualEqual] = TokenType::EQUAL_EQUAL;
+  types[kGreater] = TokenType::GREATER;
+  types[kGreaterEqual] = TokenType::GREATER_EQUAL;
+  types[kLess] = TokenType::LESS;
+  types[kLessEqual] = TokenType::LESS_EQUAL;
+  return types;
+}
+
+constexpr auto kStateTokens = make_state_tokens();
+
+}  // namespace
+
+void Scanner::scan_token_table() {
+  start_ = current_;
+  if (is_at_end()) {
+    add_token(token::TokenType::EOF_);
+    return;
+  }
+
+  const auto *bytes = reinterpret_cast<const unsigned char *>(sources_.data());
+  const std::size_t size = sources_.size();
+  std::uint8_t state = kStart;
+  std::uint8_t accepted = kError;
+  std::size_t accepted_end = current_;
+  for (std::size_t pos = current_; pos < size; ++pos) {
+    state = kNext[state][bytes[pos]];
+    if (state == kError)
+      break;
+    if (kAccepting[state]) {
+      accepted = state;
+      accepted_end = pos + 1;
+    }
+  }
+
+  if (accepted == kError) {
+    // 无法识别的字符：和 switch 模式一样直接丢弃
+    current_ = start_ + 1;
+    return;
+  }
+  current_ = accepted_end;
+
+  switch (accepted) {
+  case kSpace: break;
+  case kComment: line_comment(); break;
+  case kIdent: add_identifier(); break;
+  case kNumber: number(); break;
+  case kQuote: string(); break;
+  case kApos: character(); break;
+  case kEof: add_token(token::TokenType::EOF_); break;
+  default: add_token(kStateTokens[accepted]); break;
+  }
+}
+
+}  // namespace scanner
+}  // namespace dtoy
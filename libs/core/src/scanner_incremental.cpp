@@ -0,0 +1,137 @@
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#include "scanner.h"
+#include "token_stream.h"
+
+// 增量重扫：
+// scanner 在两次 scan_token() 之间除了位置没有别的状态，所以从任意一个
+// token 边界开始扫描，结果只取决于之后的文本。
+// 1. 保留结束位置离编辑点足够远的旧 token（number() 最多向后看两个字符），
+//    从最后一个保留 token 的结尾开始重扫；
+// 2. 一旦扫描位置越过编辑区、并且落在某个旧 token 的开头（换算回旧坐标），
+//    之后的文本和旧文本相同，剩下的旧 token 平移 offset 即可。
+// 前后没变的 token 和旧 stream 共用块，只记一个平移量，不逐个复制；
+// 文本在末尾追加时原地写（见 SourceBuffer::splice()），
+// 所以 REPL 追加一行的开销只和这一行有关。中间的编辑要保住旧文本时
+// 拷贝一次全文；Parser::reparse() 独占文本时用 SourceBuffer::Rewrite
+// 原地改写，只挪动后缀。
+
+namespace dtoy {
+namespace scanner {
+namespace {
+
+// 一个 token 的边界最多取决于它结尾之后的这么多字节
+constexpr std::size_t kLookahead = 2;
+
+}  // namespace
+
+Scanner::RelexResult Scanner::relex(const token::TokenStream &previous,
+                                    const Edit &edit, Mode mode) {
+  const auto &old_source = previous.source();
+  if (old_source == nullptr || edit.offset > old_source->size() ||
+      edit.removed > old_source->size() - edit.offset)
+    throw std::out_of_range("Edit range is outside of the source.");
+  return relex(previous, edit,
+               source::SourceBuffer::splice(old_source, edit.offset,
+                                            edit.removed, edit.inserted),
+               mode);
+}
+
+Scanner::RelexResult
+Scanner::relex(const token::TokenStream &previous, const Edit &edit,
+               std::shared_ptr<const source::SourceBuffer> text, Mode mode) {
+  const auto &old_source = previous.source();
+  if (old_source == nullptr || edit.offset > old_source->size() ||
+      edit.removed > old_source->size() - edit.offset || text == nullptr ||
+      text->size() != old_source->size() - edit.removed + edit.inserted.size())
+    throw std::out_of_range("Edit range is outside of the source.");
+
+  // 编辑区之后的文本在新旧 source 里的位置差
+  const std::ptrdiff_t shift =
+      static_cast<std::ptrdiff_t>(edit.inserted.size()) -
+      static_cast<std::ptrdiff_t>(edit.removed);
+  const std::size_t new_edit_end = edit.offset + edit.inserted.size();
+
+  // 旧 token 按位置排列，结尾也是递增的
+  std::size_t keep = 0;
+  {
+    std::size_t low = 0, high = previous.size();
+    while (low < high) {
+      std::size_t mid = (low + high) / 2;
+      if (previous.offset(mid) + previous.length(mid) + kLookahead <=
+          edit.offset)
+        low = mid + 1;
+      else
+        high = mid;
+    }
+    keep = low;
+  }
+
+  const std::size_t new_size = text->size();
+  Scanner scanner(std::move(text), 0, new_size);
+  scanner.set_mode(mode);
+  // 编辑区以外在旧 source 里已经校验过，只校验编辑区所在的完整字符
+  {
+    const std::string_view view = scanner.sources_;
+    auto continuation = [&](std::size_t i) {
+      return (static_cast<unsigned char>(view[i]) & 0xC0) == 0x80;
+    };
+    std::size_t begin = edit.offset;
+    while (begin > 0 && begin < new_size && continuation(begin))
+      --begin;
+    std::size_t end = new_edit_end;
+    while (end < new_size && continuation(end))
+      ++end;
+    scanner.check_utf8(begin, end);
+  }
+  if (keep > 0)
+    scanner.current_ = previous.offset(keep - 1) + previous.length(keep - 1);
+
+  RelexResult result{token::TokenStream(scanner.source()), keep, 0};
+  result.tokens.append(previous, 0, keep);
+
+  std::size_t resume = previous.size();  // 重新对齐的旧 token 下标
+  std::size_t candidate = keep;
+  token::TokenStream::Cursor old_tokens(previous);
+  while (true) {
+    std::size_t position = scanner.current_;
+    if (position >= new_edit_end) {
+      std::size_t old_position =
+          position - edit.inserted.size() + edit.removed;
+      while (candidate < previous.size() &&
+             old_tokens.offset(candidate) < old_position)
+        ++candidate;
+      if (candidate < previous.size() &&
+          old_tokens.offset(candidate) == old_position) {
+        resume = candidate;
+        break;
+      }
+    }
+    if (scanner.is_at_end()) {
+      result.tokens.push_back(scanner.eof_token());
+      ++result.relexed;
+      break;
+    }
+    scanner.scan_token();
+    for (const auto &token : scanner.tokens_)
+      result.tokens.push_back(token);
+    result.relexed += scanner.tokens_.size();
+    scanner.tokens_.clear();
+  }
+
+  result.tokens.append(previous, resume, previous.size(), shift);
+  // 每次编辑最多多出三段；段数比新扫描时多出一倍就整理一次，
+  // 均摊到每次编辑上是常数个块
+  if (result.tokens.piece_count() >
+      2 * (result.tokens.size() / token::TokenStream::kChunkTokens) + 16)
+    result.tokens.compact();
+  else
+    result.tokens.shrink_to_fit();
+  return result;
+}
+
+}  // namespace scanner
+}  // namespace dtoy
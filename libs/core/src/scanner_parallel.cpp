@@ -0,0 +1,126 @@
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "scanner.h"
+#include "token.h"
+
+// 并行扫描：
+// 1. 每个切分点从目标位置往后用 find_newline() 跳到第一个前面不是 '\''
+//    或 '\\' 的 '\n'，这样的换行一定不在字符字面量里，也是注释的结尾；
+//    预扫描只碰切分点附近的几个字节，不读整个文本；
+// 2. 每个块交给一个只看 [begin, end) 的 Scanner，在自己的线程里扫描；
+// 3. 按顺序确认每一块：前一块开头正确、结尾没有切断字符串（字符串可以
+//    跨行，见 Scanner::string()）时，下一块的开头也正确。切断了说明切分点
+//    落在跨行的字符串里，从那一块的开头起串行重扫剩下的部分；
+// 4. 按块的顺序把 token 拼起来。
+// 切分点上的 '\n' 本身就是 token 边界，块末尾看到的 '\0' 和看到 '\n'
+// 对所有规则都等价，所以结果和串行扫描逐个 token 相同。
+
+namespace dtoy {
+namespace scanner {
+namespace {
+
+// 太小的块不值得开线程
+constexpr std::size_t kMinChunkSize = 64 * 1024;
+
+// 返回 chunks + 1 个切分点（不足时更少），第一个是 begin，最后一个是 end
+std::vector<std::size_t> find_splits(std::string_view text, std::size_t begin,
+                                     std::size_t chunks,
+                                     const simd::Kernels &kernels) {
+  const std::size_t end = text.size();
+  const char *base = text.data();
+  std::vector<std::size_t> splits{begin};
+  for (std::size_t index = 1; index < chunks; ++index) {
+    std::size_t pos =
+        std::max(begin + (end - begin) * index / chunks, splits.back() + 1);
+    while (pos < end) {
+      pos = kernels.find_newline(base + pos, base + end) - base;
+      if (pos >= end || (text[pos - 1] != '\'' && text[pos - 1] != '\\'))
+        break;
+      ++pos;
+    }
+    if (pos >= end)
+      break;
+    splits.push_back(pos);
+  }
+  splits.push_back(end);
+  return splits;
+}
+
+}  // namespace
+
+std::vector<token::Token> Scanner::scan_tokens_parallel(unsigned threads) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  const std::size_t begin = current_;
+  const std::size_t chunks = std::clamp<std::size_t>(
+      (sources_.size() - begin) / kMinChunkSize, 1, threads);
+  if (chunks == 1)
+    return scan_tokens();
+
+  // sources_ 就是整个 buffer，块内 lexeme 依然指向同一个 SourceBuffer
+  std::vector<std::size_t> splits =
+      find_splits(sources_, begin, chunks, *kernels_);
+  const std::size_t count = splits.size() - 1;
+
+  std::vector<Scanner> parts;
+  parts.reserve(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    parts.push_back(Scanner(source_, splits[i], splits[i + 1]));
+    parts.back().kernels_ = kernels_;
+    parts.back().mode_ = mode_;
+  }
+
+  std::vector<std::exception_ptr> errors(count);
+  std::vector<std::thread> workers;
+  workers.reserve(count - 1);
+  auto work = [&](std::size_t i) {
+    try {
+      parts[i].scan_remaining();
+    } catch (...) {
+      errors[i] = std::current_exception();
+    }
+  };
+  for (std::size_t i = 1; i < count; ++i)
+    workers.emplace_back(work, i);
+  work(0);
+  for (auto &worker : workers)
+    worker.join();
+
+  // 串行扫描会在第一个出错的位置抛出，这里也只报告最靠前的块的错误；
+  // 开头不对的块的结果（包括错误）都不算
+  for (std::size_t i = 0; i < count; ++i) {
+    if (errors[i])
+      std::rethrow_exception(errors[i]);
+    if (i + 1 < count && parts[i].string_cut_) {
+      parts.erase(parts.begin() + static_cast<std::ptrdiff_t>(i), parts.end());
+      parts.push_back(Scanner(source_, splits[i], sources_.size()));
+      parts.back().kernels_ = kernels_;
+      parts.back().mode_ = mode_;
+      parts.back().scan_remaining();
+      break;
+    }
+  }
+
+  std::size_t total = tokens_.size() + 1;
+  for (const auto &part : parts)
+    total += part.tokens_.size();
+  std::vector<token::Token> tokens;
+  tokens.swap(tokens_);
+  tokens.reserve(total);
+  for (auto &part : parts)
+    std::move(part.tokens_.begin(), part.tokens_.end(),
+              std::back_inserter(tokens));
+
+  current_ = sources_.size();
+  tokens.push_back(eof_token());
+  return tokens;
+}
+
+}  // namespace scanner
+}  // namespace dtoy
@@ -0,0 +1,478 @@
+#include "simd.h"
+
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define DTOY_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace dtoy {
+namespace simd {
+namespace {
+
+// 标量版本用查表代替 std::isspace / std::isalnum，结果与 SIMD 版本逐字节一致
+const char *scalar_skip_whitespace(const char *p, const char *end) {
+  while (p < end && is_space(*p))
+    ++p;
+  return p;
+}
+
+const char *scalar_skip_identifier(const char *p, const char *end) {
+  while (p < end && is_identifier(*p))
+    ++p;
+  return p;
+}
+
+const char *scalar_skip_digits(const char *p, const char *end) {
+  while (p < end && is_digit(*p))
+    ++p;
+  return p;
+}
+
+const char *scalar_find_string_special(const char *p, const char *end) {
+  while (p < end && *p != '"' && *p != '\\')
+    ++p;
+  return p;
+}
+
+const char *scalar_find_newline(const char *p, const char *end) {
+  while (p < end && *p != '\n')
+    ++p;
+  return p;
+}
+
+// 校验从 p 开始的一个多字节 UTF-8 字符（*p >= 0x80），
+// 合法时返回它之后的位置，否则返回 nullptr。
+// 拒绝过长编码、代理区 (U+D800..U+DFFF) 和 U+10FFFF 以上的码点
+const char *utf8_sequence(const char *p, const char *end) {
+  auto byte = [&](std::ptrdiff_t i) {
+    return static_cast<unsigned char>(p[i]);
+  };
+  auto continuation = [&](std::ptrdiff_t i) {
+    return (byte(i) & 0xC0) == 0x80;
+  };
+  unsigned char lead = byte(0);
+  std::ptrdiff_t left = end - p;
+  if (lead >= 0xC2 && lead <= 0xDF)
+    return left >= 2 && continuation(1) ? p + 2 : nullptr;
+  if (lead >= 0xE0 && lead <= 0xEF) {
+    if (left < 3 || !continuation(1) || !continuation(2))
+      return nullptr;
+    if ((lead == 0xE0 && byte(1) < 0xA0) || (lead == 0xED && byte(1) >= 0xA0))
+      return nullptr;
+    return p + 3;
+  }
+  if (lead >= 0xF0 && lead <= 0xF4) {
+    if (left < 4 || !continuation(1) || !continuation(2) || !continuation(3))
+      return nullptr;
+    if ((lead == 0xF0 && byte(1) < 0x90) || (lead == 0xF4 && byte(1) >= 0x90))
+      return nullptr;
+    return p + 4;
+  }
+  return nullptr;
+}
+
+const char *scalar_validate_utf8(const char *p, const char *end) {
+  while (p < end) {
+    if (static_cast<unsigned char>(*p) < 0x80) {
+      ++p;
+      continue;
+    }
+    const char *next = utf8_sequence(p, end);
+    if (next == nullptr)
+      return p;
+    p = next;
+  }
+  return p;
+}
+
+// p 之前的字节都已经校验过，只有最后一个字符可能跨过 p 还没写完；
+// 返回重新逐字节校验的起点：那个字符的开头，或者 p 本身
+const char *utf8_restart(const char *begin, const char *p) {
+  for (std::ptrdiff_t back = 1; back <= 3 && p - back >= begin; ++back) {
+    auto c = static_cast<unsigned char>(p[-back]);
+    if ((c & 0xC0) == 0x80)
+      continue;
+    std::ptrdiff_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return length > back ? p - back : p;
+  }
+  return p;
+}
+
+#ifdef DTOY_SIMD_X86
+// 有符号字节比较：>= 0x80 的字节是负数，自然落在所有 ASCII 区间之外
+__attribute__((target("sse2"))) inline __m128i sse2_range(__m128i v, char lo,
+                                                           char hi) {
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                       _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+__attribute__((target("sse2"))) inline __m128i sse2_space(__m128i v) {
+  return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                      sse2_range(v, '\t', '\r'));
+}
+
+__attribute__((target("sse2"))) inline __m128i sse2_ident(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = sse2_range(lower, 'a', 'z');
+  __m128i digit = sse2_range(v, '0', '9');
+  __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  // 非 ASCII 字节都属于 UTF-8 标识符（source 已经校验过）
+  __m128i non_ascii = _mm_cmplt_epi8(v, _mm_setzero_si128());
+  return _mm_or_si128(_mm_or_si128(alpha, digit),
+                      _mm_or_si128(under, non_ascii));
+}
+
+__attribute__((target("sse2"))) const char *
+sse2_skip_whitespace(const char *p, const char *end) {
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned stop = ~_mm_movemask_epi8(sse2_space(v)) & 0xFFFFu;
+    if (stop != 0)
+      return p + __builtin_ctz(stop);
+    p += 16;
+  }
+  return scalar_skip_whitespace(p, end);
+}
+
+__attribute__((target("sse2"))) const char *
+sse2_skip_identifier(const char *p, const char *end) {
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned stop = ~_mm_movemask_epi8(sse2_ident(v)) & 0xFFFFu;
+    if (stop != 0)
+      return p + __builtin_ctz(stop);
+    p += 16;
+  }
+  return scalar_skip_identifier(p, end);
+}
+
+__attribute__((target("sse2"))) const char *
+sse2_skip_digits(const char *p, const char *end) {
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned stop = ~_mm_movemask_epi8(sse2_range(v, '0', '9')) & 0xFFFFu;
+    if (stop != 0)
+      return p + __builtin_ctz(stop);
+    p += 16;
+  }
+  return scalar_skip_digits(p, end);
+}
+
+__attribute__((target("sse2"))) const char *
+sse2_find_string_special(const char *p, const char *end) {
+  const __m128i quote = _mm_set1_epi8('"');
+  const __m128i slash = _mm_set1_epi8('\\');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned hit = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash)));
+    if (hit != 0)
+      return p + __builtin_ctz(hit);
+    p += 16;
+  }
+  return scalar_find_string_special(p, end);
+}
+
+__attribute__((target("sse2"))) const char *
+sse2_find_newline(const char *p, const char *end) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    unsigned hit = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl));
+    if (hit != 0)
+      return p + __builtin_ctz(hit);
+    p += 16;
+  }
+  return scalar_find_newline(p, end);
+}
+
+// UTF-8 的整块校验：每个字节只和它前面 1~3 个字节比较，不用逐个字符
+// 前进。高位字节按有符号比较是 [-128, -1]，>= lead 的字节就是 [lead, -1]。
+// SSE2 没有 pshufb，按字节分类用比较代替查表
+__attribute__((target("sse2"))) inline __m128i sse2_at_least(__m128i v,
+                                                              int lead) {
+  return _mm_and_si128(
+      _mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lead - 1))),
+      _mm_cmplt_epi8(v, _mm_setzero_si128()));
+}
+
+__attribute__((target("sse2"))) inline __m128i sse2_is(__m128i v, int byte) {
+  return _mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(byte)));
+}
+
+// 前一块是 prev，返回 v 里不合法的字节；和 utf8_sequence() 的规则相同
+__attribute__((target("sse2"))) inline __m128i sse2_utf8_errors(__m128i v,
+                                                                 __m128i prev) {
+  __m128i prev1 = _mm_or_si128(_mm_slli_si128(v, 1), _mm_srli_si128(prev, 15));
+  __m128i prev2 = _mm_or_si128(_mm_slli_si128(v, 2), _mm_srli_si128(prev, 14));
+  __m128i prev3 = _mm_or_si128(_mm_slli_si128(v, 3), _mm_srli_si128(prev, 13));
+  // 后续字节 0x80..0xBF 必须正好出现在多字节字符的开头之后
+  __m128i continuation = _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(0xC0)));
+  __m128i expected = _mm_or_si128(
+      sse2_at_least(prev1, 0xC0),
+      _mm_or_si128(sse2_at_least(prev2, 0xE0), sse2_at_least(prev3, 0xF0)));
+  __m128i errors = _mm_xor_si128(continuation, expected);
+  // 不会出现的开头：过长的 C0 / C1，U+10FFFF 以上的 F5..FF
+  errors = _mm_or_si128(errors, _mm_or_si128(sse2_is(v, 0xC0), sse2_is(v, 0xC1)));
+  errors = _mm_or_si128(errors, sse2_at_least(v, 0xF5));
+  // 第二个字节的范围：过长编码、代理区、超过 U+10FFFF
+  __m128i below_a0 = _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(0xA0)));
+  __m128i below_90 = _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(0x90)));
+  errors = _mm_or_si128(errors, _mm_and_si128(sse2_is(prev1, 0xE0), below_a0));
+  errors = _mm_or_si128(errors, _mm_and_si128(sse2_is(prev1, 0xED),
+                                              sse2_at_least(v, 0xA0)));
+  errors = _mm_or_si128(errors, _mm_and_si128(sse2_is(prev1, 0xF0), below_90));
+  errors = _mm_or_si128(errors, _mm_and_si128(sse2_is(prev1, 0xF4),
+                                              sse2_at_least(v, 0x90)));
+  return errors;
+}
+
+// 块末尾的字符是否还要下一块的后续字节
+__attribute__((target("sse2"))) inline bool sse2_utf8_spills(__m128i v) {
+  unsigned lead2 = _mm_movemask_epi8(sse2_at_least(v, 0xC0));
+  unsigned lead3 = _mm_movemask_epi8(sse2_at_least(v, 0xE0));
+  unsigned lead4 = _mm_movemask_epi8(sse2_at_least(v, 0xF0));
+  return ((lead2 >> 15) | (lead3 >> 14) | (lead4 >> 13)) != 0;
+}
+
+// 整块 ASCII（且没有上一块留下的半个字符）直接跳过，其余的整块校验；
+// 出错时从出错的字符开头逐字节找出准确的位置
+__attribute__((target("sse2"))) const char *
+sse2_validate_utf8(const char *p, const char *end) {
+  const char *begin = p;
+  __m128i prev = _mm_setzero_si128();
+  bool spill = false;
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    if (spill || _mm_movemask_epi8(v) != 0) {
+      if (_mm_movemask_epi8(sse2_utf8_errors(v, prev)) != 0)
+        break;
+      spill = sse2_utf8_spills(v);
+    }
+    prev = v;
+    p += 16;
+  }
+  return scalar_validate_utf8(utf8_restart(begin, p), end);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_range(__m256i v, char lo,
+                                                           char hi) {
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                          _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_space(__m256i v) {
+  return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                         avx2_range(v, '\t', '\r'));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_ident(__m256i v) {
+  __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i alpha = avx2_range(lower, 'a', 'z');
+  __m256i digit = avx2_range(v, '0', '9');
+  __m256i under = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+  __m256i non_ascii = _mm256_cmpgt_epi8(_mm256_setzero_si256(), v);
+  return _mm256_or_si256(_mm256_or_si256(alpha, digit),
+                         _mm256_or_si256(under, non_ascii));
+}
+
+__attribute__((target("avx2"))) inline std::uint32_t avx2_mask(__m256i v) {
+  return static_cast<std::uint32_t>(_mm256_movemask_epi8(v));
+}
+
+__attribute__((target("avx2"))) const char *
+avx2_skip_whitespace(const char *p, const char *end) {
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    std::uint32_t stop = ~avx2_mask(avx2_space(v));
+    if (stop != 0)
+      return p + __builtin_ctz(stop);
+    p += 32;
+  }
+  return sse2_skip_whitespace(p, end);
+}
+
+__attribute__((target("avx2"))) const char *
+avx2_skip_identifier(const char *p, const char *end) {
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    std::uint32_t stop = ~avx2_mask(avx2_ident(v));
+    if (stop != 0)
+      return p + __builtin_ctz(stop);
+    p += 32;
+  }
+  return sse2_skip_identifier(p, end);
+}
+
+__attribute__((target("avx2"))) const char *
+avx2_skip_digits(const char *p, const char *end) {
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    std::uint32_t stop = ~avx2_mask(avx2_range(v, '0', '9'));
+    if (stop != 0)
+      return p + __builtin_ctz(stop);
+    p += 32;
+  }
+  return sse2_skip_digits(p, end);
+}
+
+__attribute__((target("avx2"))) const char *
+avx2_find_string_special(const char *p, const char *end) {
+  const __m256i quote = _mm256_set1_epi8('"');
+  const __m256i slash = _mm256_set1_epi8('\\');
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    std::uint32_t hit = avx2_mask(_mm256_or_si256(
+        _mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash)));
+    if (hit != 0)
+      return p + __builtin_ctz(hit);
+    p += 32;
+  }
+  return sse2_find_string_special(p, end);
+}
+
+__attribute__((target("avx2"))) const char *
+avx2_find_newline(const char *p, const char *end) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    std::uint32_t hit = avx2_mask(_mm256_cmpeq_epi8(v, nl));
+    if (hit != 0)
+      return p + __builtin_ctz(hit);
+    p += 32;
+  }
+  return sse2_find_newline(p, end);
+}
+
+// 和 SSE2 版本的规则逐条对应；跨 128 位 lane 的移位用 permute + alignr
+__attribute__((target("avx2"))) inline __m256i avx2_at_least(__m256i v,
+                                                              int lead) {
+  return _mm256_and_si256(
+      _mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(lead - 1))),
+      _mm256_cmpgt_epi8(_mm256_setzero_si256(), v));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_is(__m256i v, int byte) {
+  return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(static_cast<char>(byte)));
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_below(__m256i v, int byte) {
+  return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(byte)), v);
+}
+
+__attribute__((target("avx2"))) inline __m256i avx2_utf8_errors(__m256i v,
+                                                                 __m256i prev) {
+  // 高 lane 接低 lane，低 lane 接上一块的高 lane
+  __m256i carried = _mm256_permute2x128_si256(prev, v, 0x21);
+  __m256i prev1 = _mm256_alignr_epi8(v, carried, 15);
+  __m256i prev2 = _mm256_alignr_epi8(v, carried, 14);
+  __m256i prev3 = _mm256_alignr_epi8(v, carried, 13);
+  __m256i continuation = avx2_below(v, 0xC0);
+  __m256i expected = _mm256_or_si256(
+      avx2_at_least(prev1, 0xC0),
+      _mm256_or_si256(avx2_at_least(prev2, 0xE0), avx2_at_least(prev3, 0xF0)));
+  __m256i errors = _mm256_xor_si256(continuation, expected);
+  errors = _mm256_or_si256(errors,
+                           _mm256_or_si256(avx2_is(v, 0xC0), avx2_is(v, 0xC1)));
+  errors = _mm256_or_si256(errors, avx2_at_least(v, 0xF5));
+  errors = _mm256_or_si256(
+      errors, _mm256_and_si256(avx2_is(prev1, 0xE0), avx2_below(v, 0xA0)));
+  errors = _mm256_or_si256(
+      errors, _mm256_and_si256(avx2_is(prev1, 0xED), avx2_at_least(v, 0xA0)));
+  errors = _mm256_or_si256(
+      errors, _mm256_and_si256(avx2_is(prev1, 0xF0), avx2_below(v, 0x90)));
+  errors = _mm256_or_si256(
+      errors, _mm256_and_si256(avx2_is(prev1, 0xF4), avx2_at_least(v, 0x90)));
+  return errors;
+}
+
+__attribute__((target("avx2"))) inline bool avx2_utf8_spills(__m256i v) {
+  std::uint32_t lead2 = avx2_mask(avx2_at_least(v, 0xC0));
+  std::uint32_t lead3 = avx2_mask(avx2_at_least(v, 0xE0));
+  std::uint32_t lead4 = avx2_mask(avx2_at_least(v, 0xF0));
+  return ((lead2 >> 31) | (lead3 >> 30) | (lead4 >> 29)) != 0;
+}
+
+__attribute__((target("avx2"))) const char *
+avx2_validate_utf8(const char *p, const char *end) {
+  const char *begin = p;
+  __m256i prev = _mm256_setzero_si256();
+  bool spill = false;
+  while (end - p >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+    if (spill || avx2_mask(v) != 0) {
+      if (avx2_mask(avx2_utf8_errors(v, prev)) != 0)
+        break;
+      spill = avx2_utf8_spills(v);
+    }
+    prev = v;
+    p += 32;
+  }
+  return sse2_validate_utf8(utf8_restart(begin, p), end);
+}
+#endif  // DTOY_SIMD_X86
+
+constexpr Kernels kScalar = {
+    Level::Scalar,         scalar_skip_whitespace,
+    scalar_skip_identifier, scalar_skip_digits,
+    scalar_find_string_special, scalar_find_newline,
+    scalar_validate_utf8,
+};
+
+#ifdef DTOY_SIMD_X86
+constexpr Kernels kSSE2 = {
+    Level::SSE2,         sse2_skip_whitespace,     sse2_skip_identifier,
+    sse2_skip_digits,    sse2_find_string_special, sse2_find_newline,
+    sse2_validate_utf8,
+};
+constexpr Kernels kAVX2 = {
+    Level::AVX2,         avx2_skip_whitespace,     avx2_skip_identifier,
+    avx2_skip_digits,    avx2_find_string_special, avx2_find_newline,
+    avx2_validate_utf8,
+};
+#endif
+
+Level detect_level() {
+#ifdef DTOY_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Level::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return Level::SSE2;
+#endif
+  return Level::Scalar;
+}
+
+}  // namespace
+
+Level best_level() {
+  static const Level level = detect_level();
+  return level;
+}
+
+const Kernels &kernels(Level level) {
+  Level best = best_level();
+  if (static_cast<int>(level) > static_cast<int>(best))
+    level = best;
+  switch (level) {
+#ifdef DTOY_SIMD_X86
+  case Level::AVX2: return kAVX2;
+  case Level::SSE2: return kSSE2;
+#endif
+  default: return kScalar;
+  }
+}
+
+const char *level_name(Level level) {
+  switch (level) {
+  case Level::SSE2: return "sse2";
+  case Level::AVX2: return "avx2";
+  default: return "scalar";
+  }
+}
+
+}  // namespace simd
+}  // namespace dtoy
@@ -0,0 +1,179 @@
+#include "source.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+#include "simd.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define DTOY_HAVE_MMAP 1
+#endif
+
+namespace dtoy {
+namespace source {
+namespace {
+
+[[noreturn]] void open_error(const std::string &path, int error) {
+  throw std::runtime_error("Cannot read '" + path +
+                           "': " + std::strerror(error));
+}
+
+// 不能映射时的退路：按块读到结尾，管道也适用
+std::string read_all(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    open_error(path, errno);
+  std::string text;
+  char chunk[64 * 1024];
+  while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+    text.append(chunk, static_cast<std::size_t>(in.gcount()));
+  if (in.bad())
+    open_error(path, errno);
+  return text;
+}
+
+// text 的 [offset, offset + removed) 换成 inserted。调用方保证容量够：
+// 在容量之内改变长度不会重新分配，编辑点之前的字节不动
+void replace_in_place(std::string &text, std::size_t offset,
+                      std::size_t removed, std::string_view inserted) {
+  const std::size_t tail = text.size() - offset - removed;
+  if (inserted.size() > removed)
+    text.resize(text.size() + (inserted.size() - removed));
+  std::memmove(text.data() + offset + inserted.size(),
+               text.data() + offset + removed, tail);
+  if (!inserted.empty())
+    std::memcpy(text.data() + offset, inserted.data(), inserted.size());
+  text.resize(offset + inserted.size() + tail);
+}
+
+}  // namespace
+
+SourceBuffer::~SourceBuffer() {
+#ifdef DTOY_HAVE_MMAP
+  if (mapping_ != nullptr)
+    ::munmap(mapping_, size_);
+#endif
+}
+
+std::shared_ptr<const SourceBuffer>
+SourceBuffer::splice(const std::shared_ptr<const SourceBuffer> &base,
+                     std::size_t offset, std::size_t removed,
+                     std::string_view inserted) {
+  const std::size_t size = base->size_ - removed + inserted.size();
+  if (offset == base->size_ && removed == 0 && base->growable_ != nullptr) {
+    Growable &storage = *base->growable_;
+    std::lock_guard<std::mutex> lock(storage.mutex);
+    // 没有别的 buffer 在 base 之后追加过，余量也够：写在原地，
+    // 容量不变就不会重新分配，已有 buffer 看到的前缀不动
+    if (storage.text.size() == base->size_ &&
+        storage.text.capacity() >= size) {
+      storage.text.append(inserted);
+      return std::shared_ptr<const SourceBuffer>(
+          new SourceBuffer(base->growable_, size));
+    }
+  }
+  auto storage = std::make_shared<Growable>();
+  storage->text.reserve(std::max<std::size_t>(size * 2, 64));
+  std::string_view text = base->view();
+  storage->text.append(text.substr(0, offset));
+  storage->text.append(inserted);
+  storage->text.append(text.substr(offset + removed));
+  return std::shared_ptr<const SourceBuffer>(
+      new SourceBuffer(std::move(storage), size));
+}
+
+SourceBuffer::Rewrite::Rewrite(const std::shared_ptr<const SourceBuffer> &base,
+                               std::size_t offset, std::size_t removed,
+                               std::string_view inserted) {
+  if (offset > base->size_ || removed > base->size_ - offset)
+    throw std::out_of_range("Edit range is outside of the source.");
+  const std::size_t size = base->size_ - removed + inserted.size();
+  // 没有别人拿着 base，文本也只有 base 在用，改写不会被别人看到
+  if (base.use_count() == 1 && base->growable_ != nullptr &&
+      base->growable_.use_count() == 1) {
+    Growable &storage = *base->growable_;
+    std::lock_guard<std::mutex> lock(storage.mutex);
+    if (storage.text.size() == base->size_ &&
+        storage.text.capacity() >= size) {
+      // 先做完可能抛异常的分配，再动文本
+      removed_.assign(storage.text, offset, removed);
+      result_ = std::shared_ptr<const SourceBuffer>(
+          new SourceBuffer(base->growable_, size));
+      replace_in_place(storage.text, offset, removed, inserted);
+      storage_ = &storage;
+      offset_ = offset;
+      inserted_ = inserted.size();
+      return;
+    }
+  }
+  result_ = splice(base, offset, removed, inserted);
+}
+
+SourceBuffer::Rewrite::~Rewrite() {
+  if (storage_ == nullptr)
+    return;
+  std::lock_guard<std::mutex> lock(storage_->mutex);
+  replace_in_place(storage_->text, offset_, inserted_, removed_);
+}
+
+std::shared_ptr<const SourceBuffer> SourceBuffer::open(const std::string &path) {
+#ifdef DTOY_HAVE_MMAP
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    open_error(path, errno);
+  struct stat info {};
+  // 空文件不能 mmap，和管道一样走读取
+  if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+    auto size = static_cast<std::size_t>(info.st_size);
+    void *mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping != MAP_FAILED) {
+      // 扫描器从头到尾只读一遍
+      ::madvise(mapping, size, MADV_SEQUENTIAL);
+      auto buffer = std::make_shared<SourceBuffer>();
+      buffer->mapping_ = mapping;
+      buffer->data_ = static_cast<const char *>(mapping);
+      buffer->size_ = size;
+      return buffer;
+    }
+  } else {
+    ::close(fd);
+  }
+#endif
+  return std::make_shared<const SourceBuffer>(read_all(path));
+}
+
+const std::vector<std::size_t> &SourceBuffer::newline_offsets() const {
+  std::call_once(newlines_once_, [this] {
+    const auto &kernels = simd::kernels();
+    const char *begin = data_;
+    const char *end = begin + size_;
+    for (const char *p = kernels.find_newline(begin, end); p < end;
+         p = kernels.find_newline(p + 1, end))
+      newlines_.push_back(static_cast<std::size_t>(p - begin));
+  });
+  return newlines_;
+}
+
+Location SourceBuffer::locate(std::size_t offset) const {
+  const auto &newlines = newline_offsets();
+  // offset 之前有几个换行，就在第几 + 1 行
+  auto it = std::lower_bound(newlines.begin(), newlines.end(), offset);
+  std::size_t line_start = it == newlines.begin() ? 0 : *std::prev(it) + 1;
+  // 列号只数字符的首字节，跳过 UTF-8 的后续字节 (10xxxxxx)
+  int column = 1;
+  for (std::size_t i = line_start; i < offset && i < size_; ++i)
+    column += (static_cast<unsigned char>(data_[i]) & 0xC0) != 0x80;
+  return Location{static_cast<int>(it - newlines.begin()) + 1, column};
+}
+
+}  // namespace source
+}  // namespace dtoy
@@ -0,0 +1,54 @@
+#include "symbol.h"
+
+#include <mutex>
+#include <stdexcept>
+
+namespace dtoy {
+namespace symbol {
+
+SymbolId SymbolTable::intern(std::string_view name) {
+  {
+    std::shared_lock lock(mutex_);
+    auto it = index_.find(name);
+    if (it != index_.end())
+      return it->second;
+  }
+
+  std::unique_lock lock(mutex_);
+  // 拿独占锁之前可能已经被别的线程插入了
+  auto it = index_.find(name);
+  if (it != index_.end())
+    return it->second;
+  if (names_.size() >= kNoSymbol)
+    throw std::length_error("Too many distinct identifiers.");
+  auto id = static_cast<SymbolId>(names_.size());
+  const std::string &stored = names_.emplace_back(name);
+  index_.emplace(stored, id);
+  return id;
+}
+
+SymbolId SymbolTable::find(std::string_view name) const {
+  std::shared_lock lock(mutex_);
+  auto it = index_.find(name);
+  return it == index_.end() ? kNoSymbol : it->second;
+}
+
+std::string_view SymbolTable::name(SymbolId id) const {
+  std::shared_lock lock(mutex_);
+  if (id >= names_.size())
+    throw std::out_of_range("Unknown symbol id " + std::to_string(id) + ".");
+  return names_[id];
+}
+
+std::size_t SymbolTable::size() const {
+  std::shared_lock lock(mutex_);
+  return names_.size();
+}
+
+SymbolTable &SymbolTable::global() {
+  static SymbolTable table;
+  return table;
+}
+
+}  // namespace symbol
+}  // namespace dtoy
@@ -1,10 +1,42 @@
 #include "token.h"
 
+#include <array>
 #include <format>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <type_traits>
 namespace dtoy {
 namespace token {
-std::map<std::string, TokenType> Token::keywords = {
+namespace {
+
+// TokenType -> 名字，按枚举值下标访问，不需要运行期初始化也没有数据竞争
+constexpr std::array<std::string_view, kTokenTypeCount> kTypeNames = {
+    // Single-character tokens.
+    "LEFT_PAREN", "RIGHT_PAREN", "LEFT_BRACE", "RIGHT_BRACE", "COMMA", "DOT",
+    "MINUS", "PLUS", "SEMICOLON", "SLASH", "STAR",
+
+    // One or two character tokens.
+    "BANG", "BANG_EQUAL", "EQUAL", "EQUAL_EQUAL", "GREATER", "GREATER_EQUAL",
+    "LESS", "LESS_EQUAL",
+
+    // Literals.
+    "IDENTIFIER", "STRING", "NUMBER", "CHAR", "BOOL",
+
+    // Keywords.
+    "AND", "CLASS", "ELSE", "FALSE", "FUN", "FOR", "IF", "NIL", "OR", "PRINT",
+    "RETURN", "SUPER", "THIS", "TRUE", "VAR", "WHILE",
+
+    "EOF_",
+};
+static_assert(kTypeNames.back() == "EOF_", "kTypeNames out of sync with TokenType");
+
+struct Keyword {
+  std::string_view text;
+  TokenType type;
+};
+
+constexpr Keyword kKeywords[] = {
     {"and", TokenType::AND},       {"class", TokenType::CLASS},
     {"else", TokenType::ELSE},     {"false", TokenType::FALSE},
     {"fun", TokenType::FUN},       {"for", TokenType::FOR},
@@ -14,75 +46,162 @@ std::map<std::string, TokenType> Token::keywords = {
     {"this", TokenType::THIS},     {"true", TokenType::TRUE},
     {"var", TokenType::VAR},       {"while", TokenType::WHILE},
 };
-std::map<TokenType, std::string> Token::type_names = {
-    // Single-character tokens.
-    {TokenType::LEFT_PAREN, "LEFT_PAREN"},
-    {TokenType::RIGHT_PAREN, "RIGHT_PAREN"},
-    {TokenType::LEFT_BRACE, "LEFT_BRACE"},
-    {TokenType::RIGHT_BRACE, "RIGHT_BRACE"},
-    {TokenType::COMMA, "COMMA"},
-    {TokenType::DOT, "DOT"},
-    {TokenType::MINUS, "MINUS"},
-    {TokenType::PLUS, "PLUS"},
-    {TokenType::SEMICOLON, "SEMICOLON"},
-    {TokenType::SLASH, "SLASH"},
-    {TokenType::STAR, "STAR"},
 
-    // One or two character tokens.
-    {TokenType::BANG, "BANG"},
-    {TokenType::BANG_EQUAL, "BANG_EQUAL"},
-    {TokenType::EQUAL, "EQUAL"},
-    {TokenType::EQUAL_EQUAL, "EQUAL_EQUAL"},
-    {TokenType::GREATER, "GREATER"},
-    {TokenType::GREATER_EQUAL, "GREATER_EQUAL"},
-    {TokenType::LESS, "LESS"},
-    {TokenType::LESS_EQUAL, "LESS_EQUAL"},
+// 关键字完美哈希：只看首字符、尾字符和长度，seed 在编译期搜索，
+// 保证 16 个关键字落在 32 个槽位里互不冲突
+constexpr std::size_t kKeywordSlots = 32;
 
-    // Literals.
-    {TokenType::IDENTIFIER, "IDENTIFIER"},
-    {TokenType::STRING, "STRING"},
-    {TokenType::CHAR, "CHAR"},
-    {TokenType::NUMBER, "NUMBER"},
-    {TokenType::BOOL, "BOOL"},
-    // Keywords.
-    {TokenType::AND, "AND"},
-    {TokenType::CLASS, "CLASS"},
-    {TokenType::ELSE, "ELSE"},
-    {TokenType::FALSE, "FALSE"},
-    {TokenType::FUN, "FUN"},
-    {TokenType::FOR, "FOR"},
-    {TokenType::IF, "IF"},
-    {TokenType::NIL, "NIL"},
-    {TokenType::OR, "OR"},
-    {TokenType::PRINT, "PRINT"},
-
-    {TokenType::RETURN, "RETURN"},
-    {TokenType::SUPER, "SUPER"},
-    {TokenType::THIS, "THIS"},
-    {TokenType::TRUE, "TRUE"},
-    {TokenType::VAR, "VAR"},
-    {TokenType::WHILE, "WHILE"},
-    {TokenType::EOF_, "EOF_"},
+constexpr std::size_t keyword_hash(std::string_view text, std::size_t seed) {
+  return (static_cast<unsigned char>(text.front()) * seed +
+          static_cast<unsigned char>(text.back()) + text.size()) &
+         (kKeywordSlots - 1);
+}
 
-};
+constexpr std::size_t find_keyword_seed() {
+  for (std::size_t seed = 1; seed < 256; ++seed) {
+    bool used[kKeywordSlots] = {};
+    bool ok = true;
+    for (const auto &keyword : kKeywords) {
+      std::size_t slot = keyword_hash(keyword.text, seed);
+      if (used[slot]) {
+        ok = false;
+        break;
+      }
+      used[slot] = true;
+    }
+    if (ok)
+      return seed;
+  }
+  return 0;
+}
+
+constexpr std::size_t kKeywordSeed = find_keyword_seed();
+static_assert(kKeywordSeed != 0, "no perfect hash seed for keywords");
+
+// 空槽位的 text 为空，查找时长度对不上直接失败
+constexpr std::array<Keyword, kKeywordSlots> make_keyword_table() {
+  std::array<Keyword, kKeywordSlots> table{};
+  for (const auto &keyword : kKeywords) {
+    table[keyword_hash(keyword.text, kKeywordSeed)] = keyword;
+  }
+  return table;
+}
+
+constexpr auto kKeywordTable = make_keyword_table();
+
+constexpr std::size_t kMaxKeywordLength = 6;
+
+}  // namespace
+
+std::string_view Token::type_name() const {
+  return kTypeNames[static_cast<std::size_t>(type_)];
+}
 
 std::string Token::to_string() const {
   return std::format("Token:{{ type: {}, lexeme: '{}', literal:{} }} ",
                      type_name(), lexeme(), literalToString());
 };
 
+char unescape(char escape_char) {
+  switch (escape_char) {
+  case 'n': return '\n';
+  case 't': return '\t';
+  case 'r': return '\r';
+  case '0': return '\0';
+  case '\'': return '\'';
+  case '"': return '"';
+  case '\\': return '\\';
+  default: return escape_char;
+  }
+}
+
+std::string StringLiteral::value() const {
+  std::string_view text = raw();
+  if (!escaped_)
+    return std::string(text);
+  std::string decoded;
+  decoded.reserve(text.size());
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (text[i] != '\\') {
+      decoded += text[i];
+      continue;
+    }
+    // 源码以反斜杠结尾时 scanner 读到的转义字符是 '\0'
+    decoded += unescape(++i < text.size() ? text[i] : '\0');
+  }
+  return decoded;
+}
+
+Literal value_of(const Constant &value) {
+  return std::visit(
+      [](const auto &constant) -> Literal {
+        using T = std::decay_t<decltype(constant)>;
+        if constexpr (std::is_same_v<T, StringLiteral>)
+          return constant.value();
+        else
+          return constant;
+      },
+      value);
+}
+
+std::string_view spelling(TokenType type) {
+  switch (type) {
+  case TokenType::MINUS: return "-";
+  case TokenType::PLUS: return "+";
+  case TokenType::SLASH: return "/";
+  case TokenType::STAR: return "*";
+  case TokenType::BANG: return "!";
+  case TokenType::BANG_EQUAL: return "!=";
+  case TokenType::EQUAL: return "=";
+  case TokenType::EQUAL_EQUAL: return "==";
+  case TokenType::GREATER: return ">";
+  case TokenType::GREATER_EQUAL: return ">=";
+  case TokenType::LESS: return "<";
+  case TokenType::LESS_EQUAL: return "<=";
+  case TokenType::AND: return "and";
+  case TokenType::OR: return "or";
+  default: return {};
+  }
+}
+
+void throw_offset_too_large() {
+  throw std::length_error("Source is too large for an AST node.");
+}
+
+void check_source_size(std::size_t size) {
+  if (size > kMaxSourceBytes)
+    throw std::length_error(std::format(
+        "Source is {} bytes; at most {} bytes can be parsed.", size,
+        kMaxSourceBytes));
+}
+
+std::string_view Name::lexeme() const {
+  if (symbol_ == symbol::kNoSymbol)
+    return {};
+  return symbol::SymbolTable::global().name(symbol_);
+}
+
 std::string Token::literalToString() const {
   struct literalVistor {
     std::string operator()(const std::monostate &) const {
       return "nil";
     }
+    std::string operator()(const std::nullptr_t &) const {
+      return "nil";
+    }
+    std::string operator()(const StringLiteral &s) const {
+      return s.value();
+    }
     std::string operator()(const std::string &s) const {
       return s;
     }
     std::string operator()(const char &c) const {
       return std::string(1, c);
     }
-    std::string operator()(const int &i) const {
+    std::string operator()(const bool &b) const {
+      return b ? "true" : "false";
+    }
+    std::string operator()(const std::int64_t &i) const {
       return std::to_string(i);
     }
     std::string operator()(const double &d) const {
@@ -92,13 +211,13 @@ std::string Token::literalToString() const {
   return std::visit(literalVistor{}, literal_);
 };
 
-std::pair<bool, TokenType> Token::isKeyword(const std::string &str) {
-  auto it = keywords.find(str);
-  if (it != keywords.end()) {
-    return {true, it->second};
-  } else {
+std::pair<bool, TokenType> Token::isKeyword(std::string_view str) {
+  if (str.empty() || str.size() > kMaxKeywordLength)
     return {false, TokenType::IDENTIFIER};
-  }
+  const Keyword &slot = kKeywordTable[keyword_hash(str, kKeywordSeed)];
+  if (slot.text == str)
+    return {true, slot.type};
+  return {false, TokenType::IDENTIFIER};
 }
 
 }  // namespace token
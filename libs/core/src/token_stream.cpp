@@ -0,0 +1,215 @@
+#include "token_stream.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace dtoy {
+namespace token {
+namespace {
+
+const Literal kNone{std::monostate{}};
+const Literal kTrue{true};
+const Literal kFalse{false};
+const Literal kNil{nullptr};
+
+// 在递增的下标表里找 index，找不到返回 -1
+std::ptrdiff_t find_index(const std::vector<std::uint32_t> &indexes,
+                          std::size_t index) {
+  auto it = std::lower_bound(indexes.begin(), indexes.end(), index);
+  if (it == indexes.end() || *it != index)
+    return -1;
+  return it - indexes.begin();
+}
+
+}  // namespace
+
+void TokenStream::push_back(const Token &token) {
+  std::string_view lexeme = token.lexeme();
+  if (!source_ || !source_->contains(lexeme))
+    throw std::invalid_argument("Token lexeme is not part of the stream source.");
+  if (source_->size() > std::numeric_limits<std::uint32_t>::max())
+    throw std::length_error("Source is too large for a TokenStream.");
+
+  if (tail_ == nullptr || pieces_.empty() || pieces_.back().chunk != tail_ ||
+      pieces_.back().end != tail_->types.size() ||
+      tail_->types.size() == kChunkTokens) {
+    tail_ = std::make_shared<Chunk>();
+    tail_->types.reserve(kChunkTokens);
+    tail_->offsets.reserve(kChunkTokens);
+    tail_->lengths.reserve(kChunkTokens);
+    add_piece({tail_, 0, 0, 0, size_});
+  }
+  Chunk &chunk = *tail_;
+  auto local = static_cast<std::uint32_t>(chunk.types.size());
+  chunk.types.push_back(static_cast<std::uint8_t>(token.type()));
+  chunk.offsets.push_back(static_cast<std::uint32_t>(source_->offset_of(lexeme)));
+  chunk.lengths.push_back(static_cast<std::uint32_t>(lexeme.size()));
+
+  switch (token.type()) {
+  case TokenType::TRUE:
+  case TokenType::FALSE:
+  case TokenType::NIL:
+    break;
+  default:
+    if (!std::holds_alternative<std::monostate>(token.literal())) {
+      chunk.literal_index.push_back(local);
+      chunk.literals.push_back(token.literal());
+      auto str = std::get_if<StringLiteral>(&token.literal());
+      chunk.string_offsets.push_back(
+          str == nullptr
+              ? 0
+              : static_cast<std::uint32_t>(source_->offset_of(str->raw())));
+    }
+    break;
+  }
+  if (token.symbol() != symbol::kNoSymbol) {
+    chunk.symbol_index.push_back(local);
+    chunk.symbols.push_back(token.symbol());
+  }
+  ++pieces_.back().end;
+  ++size_;
+}
+
+void TokenStream::add_piece(Piece piece) {
+  if (!pieces_.empty()) {
+    Piece &last = pieces_.back();
+    // 接在同一块的同一段后面、平移也相同，合成一段
+    if (last.chunk == piece.chunk && last.end == piece.begin &&
+        last.shift == piece.shift) {
+      last.end = piece.end;
+      return;
+    }
+    // 前一段不满，之后的下标就不能直接按块大小算了
+    if (last.end - last.begin != kChunkTokens)
+      uniform_ = false;
+  }
+  pieces_.push_back(std::move(piece));
+}
+
+void TokenStream::append(const TokenStream &other, std::size_t first,
+                         std::size_t last, std::ptrdiff_t shift) {
+  if (first >= last)
+    return;
+  if (source_->size() > std::numeric_limits<std::uint32_t>::max())
+    throw std::length_error("Source is too large for a TokenStream.");
+  const Piece *piece = &other.find(first);
+  for (std::size_t index = first; index < last;) {
+    std::size_t end = std::min(last, piece->start + (piece->end - piece->begin));
+    add_piece({piece->chunk, static_cast<std::uint32_t>(piece->local(index)),
+               static_cast<std::uint32_t>(piece->local(end - 1) + 1),
+               piece->shift + shift, size_});
+    size_ += end - index;
+    index = end;
+    ++piece;
+  }
+}
+
+const TokenStream::Piece &TokenStream::search(std::size_t index) const {
+  auto it = std::upper_bound(
+      pieces_.begin(), pieces_.end(), index,
+      [](std::size_t value, const Piece &piece) { return value < piece.start; });
+  return *(it - 1);
+}
+
+const TokenStream::Piece &TokenStream::Cursor::find(std::size_t index) {
+  const std::vector<Piece> &pieces = stream_->pieces_;
+  if (pieces[piece_].holds(index))
+    return pieces[piece_];
+  if (piece_ + 1 < pieces.size() && pieces[piece_ + 1].holds(index))
+    return pieces[++piece_];
+  const Piece &piece = stream_->find(index);
+  piece_ = static_cast<std::size_t>(&piece - pieces.data());
+  return piece;
+}
+
+void TokenStream::reserve(std::size_t count) {
+  pieces_.reserve(count / kChunkTokens + 1);
+}
+
+void TokenStream::shrink_to_fit() {
+  pieces_.shrink_to_fit();
+  if (tail_ == nullptr)
+    return;
+  tail_->types.shrink_to_fit();
+  tail_->offsets.shrink_to_fit();
+  tail_->lengths.shrink_to_fit();
+  tail_->literal_index.shrink_to_fit();
+  tail_->literals.shrink_to_fit();
+  tail_->string_offsets.shrink_to_fit();
+  tail_->symbol_index.shrink_to_fit();
+  tail_->symbols.shrink_to_fit();
+}
+
+void TokenStream::compact() {
+  TokenStream packed(source_);
+  Cursor cursor(*this);
+  for (std::size_t i = 0; i < size_; ++i)
+    packed.push_back(cursor.at(i));
+  packed.shrink_to_fit();
+  *this = std::move(packed);
+}
+
+Literal TokenStream::literal(const Piece &piece, std::size_t index) const {
+  switch (type(piece, index)) {
+  case TokenType::TRUE: return kTrue;
+  case TokenType::FALSE: return kFalse;
+  case TokenType::NIL: return kNil;
+  default: break;
+  }
+  const Chunk &chunk = *piece.chunk;
+  std::ptrdiff_t found = find_index(chunk.literal_index, piece.local(index));
+  if (found < 0)
+    return kNone;
+  Literal value = chunk.literals[found];
+  // 块可能是别的 stream 扫出来的，原文换成这个 stream 的 source 里的同一段
+  if (auto *str = std::get_if<StringLiteral>(&value))
+    *str = StringLiteral(
+        source_->slice(static_cast<std::size_t>(chunk.string_offsets[found] +
+                                                piece.shift),
+                       str->raw().size()),
+        str->escaped());
+  return value;
+}
+
+symbol::SymbolId TokenStream::symbol(const Piece &piece,
+                                     std::size_t index) const {
+  std::ptrdiff_t found =
+      find_index(piece.chunk->symbol_index, piece.local(index));
+  return found < 0 ? symbol::kNoSymbol : piece.chunk->symbols[found];
+}
+
+Token TokenStream::at(const Piece &piece, std::size_t index) const {
+  const std::size_t start = offset(piece, index);
+  const std::string_view text = source_->slice(start, length(piece, index));
+  const TokenType kind = type(piece, index);
+  if (kind == TokenType::IDENTIFIER) {
+    symbol::SymbolId id = symbol(piece, index);
+    if (id != symbol::kNoSymbol)
+      return Token::identifier(text, id, start);
+  }
+  return Token(kind, text, literal(piece, index), start);
+}
+
+std::size_t TokenStream::memory_usage() const {
+  std::size_t bytes = pieces_.capacity() * sizeof(Piece);
+  const Chunk *previous = nullptr;
+  for (const Piece &piece : pieces_) {
+    const Chunk &chunk = *piece.chunk;
+    if (&chunk == previous)
+      continue;  // 同一块拆成的相邻几段只算一次
+    previous = &chunk;
+    bytes += chunk.types.capacity() * sizeof(std::uint8_t) +
+             chunk.offsets.capacity() * sizeof(std::uint32_t) +
+             chunk.lengths.capacity() * sizeof(std::uint32_t) +
+             chunk.literal_index.capacity() * sizeof(std::uint32_t) +
+             chunk.literals.capacity() * sizeof(Literal) +
+             chunk.string_offsets.capacity() * sizeof(std::uint32_t) +
+             chunk.symbol_index.capacity() * sizeof(std::uint32_t) +
+             chunk.symbols.capacity() * sizeof(symbol::SymbolId);
+  }
+  return bytes;
+}
+
+}  // namespace token
+}  // namespace dtoy
@@ -1,47 +1,109 @@
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <optional>
 #include <string>
 #include <vector>
 
+#include "ast.h"
+#include "ast_cache.h"
+#include "flat_ast.h"
 #include "interpreter.h"
+#include "optimizer.h"
 #include "parser.h"
 #include "scanner.h"
+#include "source.h"
 #include "stmt.h"
+#include "token_stream.h"
 
 using namespace dtoy;
 
-void run(const std::string &source) {
+// --no-fold 关掉 parse 之后的常量折叠
+bool fold = true;
+// --share 合并重复的子表达式，用树形解释器运行，同一条语句里复用算好的值；
+// 扁平 AST 会把共用的子树重新展开，所以这时不经过 .dtast 缓存
+bool share = false;
+// 超过这个大小的脚本文件并行解析
+constexpr std::size_t kParallelParseBytes = 4 * 1024 * 1024;
+
+// REPL 的整个会话是一个只在末尾追加的文档：每一行只重新扫描、解析新加的
+// 部分，只执行新加的语句；解释器在行之间保留，变量一直有效
+void runLine(parser::Parser::Document &document,
+             interpreter::Interpreter &interpreter, const std::string &line) {
   try {
-    // 词法分析
-    scanner::Scanner scanner(source);
-    std::vector<token::Token> tokens = scanner.scan_tokens();
-
-    // // 语法分析
-    // parser::Parser parser(tokens);
-    // std::unique_ptr<expr::Expr> expression = parser.expression();
-
-    parser::Parser parser(tokens);
-    std::vector<std::unique_ptr<stmt::Stmt>> statements = parser.parse();
-    interpreter::Interpreter interpreter;
-    interpreter.interpret(statements);
-
-
-    
-    // // 解释执行
-    // interpreter::Interpreter interpreter;
-    // interpreter.interpret(*expression);
-
+    scanner::Scanner::Edit edit{document.tokens.source()->size(), 0,
+                                line + "\n"};
+    // 出错时 document 不变，这一行不算进会话
+    parser::Parser::ReparseResult result =
+        parser::Parser::reparse(std::move(document), edit);
+    document = std::move(result.document);
+    std::vector<stmt::Stmt *> added(
+        document.program.begin() + result.first,
+        document.program.begin() + result.first + result.inserted);
+    if (fold)
+      for (stmt::Stmt *statement : added)
+        optimizer::fold_constants(*statement, document.program.arena());
+    interpreter.set_source(document.tokens.source());
+    interpreter.interpret(added);
   } catch (const std::exception &e) {
     std::cerr << "Error: " << e.what() << std::endl;
   }
 }
 
 void runFile(const std::string &filename) {
-  // 这里可以添加从文件读取代码的功能
-  std::cout << "File execution not implemented yet." << std::endl;
+  // 直接扫描文件映射，不先读进 std::string
+  std::shared_ptr<const source::SourceBuffer> source;
+  try {
+    source = source::SourceBuffer::open(filename);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+    return;
+  }
+
+  try {
+    // AST 里的位置只有 32 位，超过 4 GB 的脚本在算缓存 key 之前就报错
+    token::check_source_size(source->size());
+    if (share) {
+      scanner::Scanner scanner(source);
+      ast::Program program = parser::Parser(scanner).parse();
+      if (fold)
+        optimizer::fold_constants(program);
+      optimizer::share_subexpressions(program);
+      interpreter::Interpreter(source).interpret(program);
+      return;
+    }
+    // 源码没变时直接映射上次留下的 .dtast，跳过扫描和解析
+    const std::string cache = ast::AstCache::path_for(filename);
+    const std::uint64_t key = ast::AstCache::key(*source, fold);
+    std::optional<ast::FlatAst> tree = ast::AstCache::load(cache, source, key);
+    if (!tree) {
+      scanner::Scanner scanner(source);
+      ast::Program program;
+      if (source->size() >= kParallelParseBytes) {
+        // 大脚本先扫描成紧凑的 TokenStream，再按顶层语句并行解析
+        token::TokenStream stream = scanner.scan_token_stream();
+        program = parser::Parser(stream).parse_parallel();
+      } else {
+        program = parser::Parser(scanner).parse();
+      }
+      if (fold)
+        optimizer::fold_constants(program);
+      tree = ast::FlatAst::build(program, source);
+      ast::AstCache::store(cache, *tree, key);  // 写不了就下次再解析
+    }
+    interpreter::Interpreter interpreter(source);
+    interpreter.interpret(*tree);
+  } catch (const std::exception &e) {
+    std::cerr << "Error: " << e.what() << std::endl;
+  }
 }
 
 void runPrompt() {
   std::string line;
+  parser::Parser::Document document = parser::Parser::parse_document(
+      scanner::Scanner(std::string{}).scan_token_stream());
+  interpreter::Interpreter interpreter(document.tokens.source());
 
   std::cout << "dtoy Interactive Interpreter" << std::endl;
   std::cout << "Enter expressions to evaluate. Type 'exit' to quit."
@@ -59,7 +121,7 @@ void runPrompt() {
     }
 
     if (!line.empty()) {
-      run(line);
+      runLine(document, interpreter, line);
     }
   }
 
@@ -67,11 +129,21 @@ void runPrompt() {
 }
 
 int main(int argc, char *argv[]) {
-  if (argc > 2) {
-    std::cout << "Usage: dtoy [script]"  << std::endl;
+  std::vector<std::string> args(argv + 1, argv + argc);
+  while (!args.empty() && args.front().starts_with("--")) {
+    if (args.front() == "--no-fold")
+      fold = false;
+    else if (args.front() == "--share")
+      share = true;
+    else
+      break;
+    args.erase(args.begin());
+  }
+  if (args.size() > 1) {
+    std::cout << "Usage: dtoy [--no-fold] [--share] [script]"  << std::endl;
     return 1;
-  } else if (argc == 2) {
-    runFile(argv[1]);
+  } else if (args.size() == 1) {
+    runFile(args.front());
   } else {
     runPrompt();
   }
@@ -1,6 +1,7 @@
 #include "interpreter.h"
 #include <gtest/gtest.h>
 #include "scanner.h"
+#include "optimizer.h"
 #include "parser.h"
 
 namespace dtoy {
@@ -16,8 +17,8 @@ TEST(Interpreter, Literal) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), 42);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), 42);
     }
     // Double literal test
     {
@@ -112,8 +113,8 @@ TEST(Interpreter, UnaryExpression) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), -5);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), -5);
     }
 
     // Test for negation of a double: -3.14
@@ -154,8 +155,8 @@ TEST(Interpreter, BinaryExpression) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), 3);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), 3);
     }
     // Test for addition of two doubles: 1.5 + 2.5
     {
@@ -191,8 +192,8 @@ TEST(Interpreter, BinaryExpression) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), 2);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), 2);
     }
 
     // Test for multiplication of two doubles: 2.0 * 3.5
@@ -217,8 +218,8 @@ TEST(Interpreter, BinaryExpression) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), 4);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), 4);
     }
 
     // Test for division by zero
@@ -239,6 +240,28 @@ TEST(Interpreter, BinaryExpression) {
         }
     }
 
+    // 整数溢出报错，不回绕；INT64_MIN / -1 也不会 SIGFPE
+    for (const char *text :
+         {"9223372036854775807 + 1", "(-9223372036854775807 - 1) - 1",
+          "4611686018427387904 * 2", "(-9223372036854775807 - 1) / -1",
+          "-(-9223372036854775807 - 1)"}) {
+        scanner::Scanner scanner(text);
+        parser::Parser parser1(scanner.scan_tokens());
+        Interpreter interpreter;
+        try {
+            interpreter.evaluate(*parser1.expression());
+            ADD_FAILURE() << "Expected RuntimeError for " << text;
+        } catch (const RuntimeError &e) {
+            EXPECT_STREQ(e.what(), "Integer overflow.") << text;
+        }
+    }
+    {
+        scanner::Scanner scanner("(-9223372036854775807 - 1) / 1 + 9223372036854775807");
+        parser::Parser parser1(scanner.scan_tokens());
+        Interpreter interpreter;
+        EXPECT_EQ(interpreter.evaluate(*parser1.expression()), token::Literal{std::int64_t{-1}});
+    }
+
     // Test for equality: 3 == 3
     {
         scanner::Scanner scanner("3 == 3");
@@ -312,8 +335,8 @@ TEST(Interpreter, GroupingExpression) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), 9);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), 9);
     }
 
     // test for nested grouping expression: ((2 + 3) * (4 - 1))
@@ -325,8 +348,8 @@ TEST(Interpreter, GroupingExpression) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), 15);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), 15);
     }
 }
 
@@ -340,8 +363,224 @@ TEST(Interpreter, ComplexExpression) {
         EXPECT_NE(expr, nullptr);
         Interpreter interpreter;
         auto result = interpreter.evaluate(*expr);
-        EXPECT_TRUE(std::holds_alternative<int>(result));
-        EXPECT_EQ(std::get<int>(result), 3);
+        EXPECT_TRUE(std::holds_alternative<std::int64_t>(result));
+        EXPECT_EQ(std::get<std::int64_t>(result), 3);
+    }
+}
+
+TEST(Interpreter, Variables) {
+    scanner::Scanner scanner("var count = 1; var other; count = count + 41;");
+    parser::Parser parser1(scanner.scan_tokens());
+    auto statements = parser1.parse();
+    Interpreter interpreter;
+    interpreter.interpret(statements);
+
+    // 同名标识符在不同的扫描里驻留成同一个 id
+    scanner::Scanner lookup("count");
+    auto tokens = lookup.scan_tokens();
+    EXPECT_EQ(tokens[0].symbol(), std::get<stmt::VarStmt>(*statements[0]).name.symbol());
+    parser::Parser parser2(tokens);
+    auto result = interpreter.evaluate(*parser2.expression());
+    EXPECT_EQ(std::get<std::int64_t>(result), 42);
+
+    scanner::Scanner undefined("missing");
+    parser::Parser parser3(undefined.scan_tokens());
+    EXPECT_THROW(interpreter.evaluate(*parser3.expression()), std::runtime_error);
+}
+TEST(Interpreter, FlatAst) {
+    // 扁平 AST 和树形 AST 的求值结果相同
+    const std::vector<std::string> expressions = {
+        "1 + 2 * 3", "-(3 + 4) * (2 - 5) / 7", "2.5 * 2 - 1.0",
+        "!(1 < 2) == false", "\"a\" + \"b\\n\"", "nil", "7 / 0"};
+    for (const auto &text : expressions) {
+        scanner::Scanner scanner(text + ";");
+        parser::Parser parser1(scanner.scan_tokens(), scanner.source());
+        auto program = parser1.parse();
+        auto tree = ast::FlatAst::build(program, scanner.source());
+        const auto &statement = std::get<stmt::ExpressionStmt>(*program[0]);
+        std::uint32_t root = tree.operand(tree.statements()[0]);
+
+        Interpreter by_tree;
+        Interpreter by_flat;
+        try {
+            auto expected = by_tree.evaluate(*statement.expression);
+            EXPECT_EQ(by_flat.evaluate(tree, root), expected) << text;
+        } catch (const RuntimeError &error) {
+            EXPECT_THROW(by_flat.evaluate(tree, root), RuntimeError) << text;
+        }
+    }
+
+    // 语句：变量在同一个 interpreter 的环境里
+    scanner::Scanner scanner("var count = 1; var other; count = count + 41;");
+    parser::Parser parser1(scanner.scan_tokens());
+    auto program = parser1.parse();
+    auto tree = ast::FlatAst::build(program, scanner.source());
+    Interpreter interpreter;
+    interpreter.interpret(tree);
+
+    scanner::Scanner lookup("count");
+    parser::Parser parser2(lookup.scan_tokens());
+    EXPECT_EQ(std::get<std::int64_t>(interpreter.evaluate(*parser2.expression())), 42);
+}
+TEST(Interpreter, ConstantFolding) {
+    // 折叠和不折叠的树求值结果相同，运行时错误也照旧在运行时抛出
+    const std::vector<std::string> expressions = {
+        "60 * 60 * 24", "\"prefix\" + \"suffix\"", "-(-5)", "!!true",
+        "(1 + 2) * (3 - 4) / 2", "2.5 * 2.0 - 0.5", "\"a\\n\" == \"a\\n\"",
+        "nil == nil", "1 < 2 == true", "1 / 0", "1 + \"a\"", "-\"a\"",
+        "-(-x)", "-(-s)", "!!b", "!!x", "-(-(-x))", "!!(x < 1)",
+        "(x = 4) * 1", "(x = 5) + 0.0", "(s = \"q\") + \"\"", "(d = 1.5) * 1.0",
+        "(d = -0.0) + 0.0", "0 + (x = 6) - 0",
+        "(-9223372036854775807 - 1) / -1", "9223372036854775807 * 2",
+        "-(-(-9223372036854775807 - 1))", "-(-(x * 0 - 9223372036854775807 - 1))"};
+    const std::string setup = "var x = 3; var s = \"a\"; var b = true; var d = 0.5;";
+
+    auto prepare = [&setup](Interpreter &interpreter) {
+        scanner::Scanner scanner(setup);
+        parser::Parser parser(scanner.scan_tokens());
+        interpreter.interpret(parser.parse());
+    };
+    Interpreter plain;
+    Interpreter folded;
+    prepare(plain);
+    prepare(folded);
+
+    for (const auto &text : expressions) {
+        scanner::Scanner scanner(text);
+        auto tokens = scanner.scan_tokens();
+        parser::Parser parser1(tokens);
+        parser::Parser parser2(tokens);
+        expr::Expr *original = parser1.expression();
+        expr::Expr *optimized = parser2.expression();
+        optimizer::fold_constants(optimized, parser2.arena());
+
+        std::optional<token::Literal> expected;
+        try {
+            expected = plain.evaluate(*original);
+        } catch (const std::runtime_error &) {
+        }
+        if (expected) {
+            EXPECT_EQ(folded.evaluate(*optimized), *expected) << text;
+        } else {
+            EXPECT_THROW(folded.evaluate(*optimized), std::runtime_error) << text;
+        }
+    }
+
+    // 折叠的结果
+    scanner::Scanner scanner("print 60 * 60 * 24; print (1 / 0); print -(-x); print (x = 1) * 1;");
+    parser::Parser parser1(scanner.scan_tokens());
+    auto program = parser1.parse();
+    auto stats = optimizer::fold_constants(program);
+    EXPECT_EQ(stats.folded, 2u);
+    EXPECT_EQ(stats.groupings, 3u);
+    EXPECT_EQ(stats.identities, 1u);
+    auto value = [&program](std::size_t index) {
+        return std::get<stmt::PrintStmt>(*program[index]).expression;
+    };
+    EXPECT_EQ(std::get<expr::LiteralExpr>(*value(0)).value, token::Constant{std::int64_t{86400}});
+    EXPECT_TRUE(std::holds_alternative<expr::BinaryExpr>(*value(1)));
+    EXPECT_TRUE(std::holds_alternative<expr::UnaryExpr>(*value(2)));
+    EXPECT_TRUE(std::holds_alternative<expr::AssignExpr>(*value(3)));
+
+    // 会溢出的运算留到运行时报错，优化阶段不会崩溃
+    scanner::Scanner overflow("print (-9223372036854775807 - 1) / -1;");
+    parser::Parser parser3(overflow.scan_tokens());
+    auto overflow_program = parser3.parse();
+    EXPECT_EQ(optimizer::fold_constants(overflow_program).folded, 3u);
+    EXPECT_TRUE(std::holds_alternative<expr::BinaryExpr>(
+        *std::get<stmt::PrintStmt>(*overflow_program[0]).expression));
+    Interpreter runner;
+    testing::internal::CaptureStderr();
+    runner.interpret(overflow_program);
+    EXPECT_NE(testing::internal::GetCapturedStderr().find("Integer overflow."),
+              std::string::npos);
+
+    // 折叠出来的字符串放在 program 的 arena 里，不进全局符号表
+    const std::size_t symbols = symbol::SymbolTable::global().size();
+    scanner::Scanner strings("print \"fold\" + \"ed\" + \"\\n\";");
+    parser::Parser parser2(strings.scan_tokens());
+    auto folded_program = parser2.parse();
+    EXPECT_EQ(optimizer::fold_constants(folded_program).folded, 2u);
+    const auto &literal = std::get<token::StringLiteral>(
+        std::get<expr::LiteralExpr>(
+            *std::get<stmt::PrintStmt>(*folded_program[0]).expression)
+            .value);
+    EXPECT_EQ(literal.value(), "folded\n");
+    EXPECT_TRUE(folded_program.arena().owns(literal.raw().data()));
+    EXPECT_EQ(symbol::SymbolTable::global().size(), symbols);
+
+    // 合并到新 arena 时字符串跟着复制，旧 arena 释放之后照样能用
+    optimizer::share_subexpressions(folded_program);
+    Interpreter interpreter;
+    testing::internal::CaptureStdout();
+    interpreter.interpret(folded_program);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "folded\n\n");
+}
+TEST(Interpreter, SharedSubexpressions) {
+    // 合并前后输出相同，运行时错误的位置也相同
+    const std::string text =
+        "var a = 2; var b = 3; var s = \"x\";\n"
+        "print (a + b) * (a + b);\n"
+        "print (a + b) * 2; print s + s == s + s;\n"
+        "print (a + b) + (a = 10) + (a + b);\n"
+        "print -a * -a; print a * b - a * b;\n"
+        "print a / (b - 3) + a / (b - 3);\n";
+    auto run = [&text](bool share, optimizer::ShareStats &stats,
+                       std::size_t &bytes) {
+        scanner::Scanner scanner(text);
+        parser::Parser parser(scanner);
+        auto program = parser.parse();
+        if (share)
+            stats = optimizer::share_subexpressions(program);
+        bytes = program.arena().bytes_used();
+        Interpreter interpreter(scanner.source());
+        testing::internal::CaptureStdout();
+        testing::internal::CaptureStderr();
+        interpreter.interpret(program);
+        std::string output = testing::internal::GetCapturedStdout();
+        return output + testing::internal::GetCapturedStderr();
+    };
+    optimizer::ShareStats stats;
+    std::size_t plain_bytes = 0;
+    std::size_t shared_bytes = 0;
+    std::string expected = run(false, stats, plain_bytes);
+    EXPECT_EQ(run(true, stats, shared_bytes), expected);
+    EXPECT_NE(expected.find("Division by zero. [line 6"), std::string::npos);
+    EXPECT_LT(shared_bytes, plain_bytes);
+    EXPECT_GT(stats.shared, 0u);
+    // (a + b)、s + s、-a、a * b 和 a / (b - 3) 各复用一次；
+    // 赋值之后的 a + b 要重新求值
+    EXPECT_EQ(stats.cached, 5u);
+
+    // 赋值之后的读取不复用前面的值
+    scanner::Scanner scanner("var a = 1; print (a + 1) + (a = 5) + (a + 1);");
+    parser::Parser parser(scanner);
+    auto program = parser.parse();
+    EXPECT_EQ(optimizer::share_subexpressions(program).cached, 0u);
+    Interpreter interpreter;
+    testing::internal::CaptureStdout();
+    interpreter.interpret(program);
+    EXPECT_EQ(testing::internal::GetCapturedStdout(), "13\n");
+}
+
+TEST(Interpreter, ReparsedErrorLocation) {
+    // 增量解析沿用的语句只记了平移，报错的行列号要算上它
+    auto document = parser::Parser::parse_document(
+        scanner::Scanner("var a = 1;\nvar b = 0;\nprint a / b;\n")
+            .scan_token_stream());
+    auto result = parser::Parser::reparse(std::move(document),
+                                          {8, 1, "\n  100"});
+    document = std::move(result.document);
+    ASSERT_EQ(document.program.shift(2), 5);
+    for (bool share : {false, true}) {
+        if (share)
+            optimizer::share_subexpressions(document.program);
+        Interpreter interpreter(document.tokens.source());
+        testing::internal::CaptureStderr();
+        interpreter.interpret(document.program);
+        EXPECT_NE(testing::internal::GetCapturedStderr().find(
+                      "Division by zero. [line 4, column 9]"),
+                  std::string::npos);
     }
 }
 } // namespace interpreter
@@ -1,7 +1,17 @@
+#include "ast_cache.h"
+#include "flat_ast.h"
 #include "parser.h"
 #include "scanner.h"
 #include "gtest/gtest.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
 namespace dtoy {
 namespace parser {
 
@@ -52,7 +62,7 @@ TEST(parserTest, testPrimary) {
     EXPECT_NE(expr, nullptr);
     EXPECT_TRUE(std::holds_alternative<expr::LiteralExpr>(*expr));
     const auto &literal = std::get<expr::LiteralExpr>(*expr);
-    EXPECT_EQ(std::get<int>(literal.value), 123);
+    EXPECT_EQ(std::get<std::int64_t>(literal.value), 123);
   }
 
   {
@@ -76,7 +86,7 @@ TEST(parserTest, testPrimary) {
     EXPECT_NE(expr, nullptr);
     EXPECT_TRUE(std::holds_alternative<expr::LiteralExpr>(*expr));
     const auto &literal = std::get<expr::LiteralExpr>(*expr);
-    EXPECT_EQ(std::get<std::string>(literal.value), "hello");
+    EXPECT_EQ(std::get<token::StringLiteral>(literal.value).value(), "hello");
   }
 
   {
@@ -88,7 +98,7 @@ TEST(parserTest, testPrimary) {
     EXPECT_NE(expr, nullptr);
     EXPECT_TRUE(std::holds_alternative<expr::LiteralExpr>(*expr));
     const auto &literal = std::get<expr::LiteralExpr>(*expr);
-    EXPECT_EQ(std::get<std::string>(literal.value), "");
+    EXPECT_EQ(std::get<token::StringLiteral>(literal.value).value(), "");
   }
 
   {
@@ -131,7 +141,7 @@ TEST(parserTest, testPrimary) {
         std::holds_alternative<expr::LiteralExpr>(*innerGroup.expression));
 
     const auto &literal = std::get<expr::LiteralExpr>(*innerGroup.expression);
-    EXPECT_EQ(std::get<int>(literal.value), 123);
+    EXPECT_EQ(std::get<std::int64_t>(literal.value), 123);
   }
 
   {
@@ -220,8 +230,8 @@ TEST(parserTest, testUnary) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*unaryExpr.right);
 
     // 检查数值类型，可能是 int 或 double
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 123);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 123);
     } else if (std::holds_alternative<double>(rightLiteral.value)) {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 123.0);
     } else {
@@ -248,14 +258,14 @@ TEST(parserTest, testFactor) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*binaryExpr.right);
 
     // 检查数值类型
-    if (std::holds_alternative<int>(leftLiteral.value)) {
-      EXPECT_EQ(std::get<int>(leftLiteral.value), 3);
+    if (std::holds_alternative<std::int64_t>(leftLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(leftLiteral.value), 3);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(leftLiteral.value), 3.0);
     }
 
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 4);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 4);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 4.0);
     }
@@ -278,14 +288,14 @@ TEST(parserTest, testFactor) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*binaryExpr.right);
 
     // 检查数值类型
-    if (std::holds_alternative<int>(leftLiteral.value)) {
-      EXPECT_EQ(std::get<int>(leftLiteral.value), 10);
+    if (std::holds_alternative<std::int64_t>(leftLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(leftLiteral.value), 10);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(leftLiteral.value), 10.0);
     }
 
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 2);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 2);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 2.0);
     }
@@ -310,14 +320,14 @@ TEST(parserTest, testTerm) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*binaryExpr.right);
 
     // 检查数值类型
-    if (std::holds_alternative<int>(leftLiteral.value)) {
-      EXPECT_EQ(std::get<int>(leftLiteral.value), 5);
+    if (std::holds_alternative<std::int64_t>(leftLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(leftLiteral.value), 5);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(leftLiteral.value), 5.0);
     }
 
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 7);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 7);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 7.0);
     }
@@ -340,14 +350,14 @@ TEST(parserTest, testTerm) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*binaryExpr.right);
 
     // 检查数值类型
-    if (std::holds_alternative<int>(leftLiteral.value)) {
-      EXPECT_EQ(std::get<int>(leftLiteral.value), 20);
+    if (std::holds_alternative<std::int64_t>(leftLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(leftLiteral.value), 20);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(leftLiteral.value), 20.0);
     }
 
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 8);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 8);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 8.0);
     }
@@ -372,14 +382,14 @@ TEST(parserTest, testComparison) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*binaryExpr.right);
 
     // 检查数值类型
-    if (std::holds_alternative<int>(leftLiteral.value)) {
-      EXPECT_EQ(std::get<int>(leftLiteral.value), 10);
+    if (std::holds_alternative<std::int64_t>(leftLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(leftLiteral.value), 10);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(leftLiteral.value), 10.0);
     }
 
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 5);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 5);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 5.0);
     }
@@ -404,14 +414,14 @@ TEST(parserTest, testEquality) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*binaryExpr.right);
 
     // 检查数值类型
-    if (std::holds_alternative<int>(leftLiteral.value)) {
-      EXPECT_EQ(std::get<int>(leftLiteral.value), 3);
+    if (std::holds_alternative<std::int64_t>(leftLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(leftLiteral.value), 3);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(leftLiteral.value), 3.0);
     }
 
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 3);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 3);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 3.0);
     }
@@ -434,14 +444,14 @@ TEST(parserTest, testEquality) {
     const auto &rightLiteral = std::get<expr::LiteralExpr>(*binaryExpr.right);
 
     // 检查数值类型
-    if (std::holds_alternative<int>(leftLiteral.value)) {
-      EXPECT_EQ(std::get<int>(leftLiteral.value), 4);
+    if (std::holds_alternative<std::int64_t>(leftLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(leftLiteral.value), 4);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(leftLiteral.value), 4.0);
     }
 
-    if (std::holds_alternative<int>(rightLiteral.value)) {
-      EXPECT_EQ(std::get<int>(rightLiteral.value), 5);
+    if (std::holds_alternative<std::int64_t>(rightLiteral.value)) {
+      EXPECT_EQ(std::get<std::int64_t>(rightLiteral.value), 5);
     } else {
       EXPECT_DOUBLE_EQ(std::get<double>(rightLiteral.value), 5.0);
     }
@@ -496,6 +506,462 @@ TEST(parserTest, testExprPrinter) {
   }
 }
 
+TEST(parserTest, testPrecedence) {
+  auto print = [](const std::string &source) {
+    scanner::Scanner scanner(source);
+    Parser parser(scanner.scan_tokens());
+    auto expr = parser.expression();
+    testing::internal::CaptureStdout();
+    expr::ExprPrinter().print(*expr);
+    return testing::internal::GetCapturedStdout();
+  };
+  // 减法左结合，赋值右结合，一元运算符比所有二元运算符都紧
+  EXPECT_EQ(print("1 - 2 - 3"), "(-(- 1 2) 3)");
+  EXPECT_EQ(print("a = b = 1"), "(= a (= b  1))");
+  EXPECT_EQ(print("-a * b + c / d"),
+            "(+(*(-(var a))(var b))(/(var c)(var d)))");
+  EXPECT_EQ(print("1 < 2 == !false"), "(==(< 1 2)(! false))");
+
+  for (const char *invalid : {"1 + 2 = 3", "-a = 1", "a == b = c"}) {
+    scanner::Scanner scanner(invalid);
+    Parser parser(scanner.scan_tokens());
+    EXPECT_THROW(parser.expression(), std::runtime_error) << invalid;
+  }
+}
+
+TEST(parserTest, testStreamingParse) {
+  {
+    // 流式解析：parser 直接从 scanner 拉取 token
+    std::string source;
+    for (int i = 0; i < 500; ++i) {
+      source += "print " + std::to_string(i) + " + 1;\n";
+    }
+    scanner::Scanner scanner(source);
+    Parser parser(scanner);
+    auto statements = parser.parse();
+    ASSERT_EQ(statements.size(), 500);
+    const auto &last = std::get<stmt::PrintStmt>(*statements.back());
+    const auto &sum = std::get<expr::BinaryExpr>(*last.expression);
+    EXPECT_EQ(std::get<std::int64_t>(std::get<expr::LiteralExpr>(*sum.left).value), 499);
+  }
+
+  {
+    // 语法错误仍然抛出
+    scanner::Scanner scanner("print 1");
+    Parser parser(scanner);
+    EXPECT_THROW(parser.parse(), std::runtime_error);
+  }
+}
+
+TEST(parserTest, testBorrowedTokens) {
+  scanner::Scanner scanner("var total = -1 + x; print total;");
+  auto tokens = scanner.scan_tokens();
+  Parser parser(std::span<const token::Token>(tokens), scanner.source());
+  auto program = parser.parse();
+  // 节点只保存 opcode、symbol 和位置，借来的 token 释放之后 AST 依然完整
+  tokens.clear();
+  tokens.shrink_to_fit();
+  const auto &decl = std::get<stmt::VarStmt>(*program[0]);
+  EXPECT_EQ(decl.name.lexeme(), "total");
+  const auto &sum = std::get<expr::BinaryExpr>(*decl.initializer);
+  EXPECT_EQ(sum.op.type(), token::TokenType::PLUS);
+  EXPECT_EQ(std::get<expr::UnaryExpr>(*sum.left).op.lexeme(), "-");
+  EXPECT_EQ(std::get<expr::VariableExpr>(*sum.right).name.symbol(),
+            symbol::SymbolTable::global().find("x"));
+  EXPECT_LE(sizeof(token::TokenView) * 2, sizeof(token::Token));
+  // 节点不带堆内存，arena 不用给每个节点登记析构
+  EXPECT_TRUE(std::is_trivially_destructible_v<expr::Expr>);
+  EXPECT_EQ(sizeof(token::Operator), 8u);
+  EXPECT_EQ(sizeof(token::Name), 8u);
+  EXPECT_LE(sizeof(expr::Expr), 32u);
+}
+
+TEST(parserTest, testTokenStreamParse) {
+  scanner::Scanner scanner("var total = 1 + 2.5 * x;\nprint total == nil;");
+  auto stream = scanner.scan_token_stream();
+  Parser parser(stream);
+  auto statements = parser.parse();
+  ASSERT_EQ(statements.size(), 2);
+
+  const auto &decl = std::get<stmt::VarStmt>(*statements[0]);
+  EXPECT_EQ(decl.name.lexeme(), "total");
+  EXPECT_EQ(decl.name.symbol(), stream.symbol(1));
+  const auto &sum = std::get<expr::BinaryExpr>(*decl.initializer);
+  EXPECT_EQ(std::get<std::int64_t>(std::get<expr::LiteralExpr>(*sum.left).value), 1);
+  const auto &product = std::get<expr::BinaryExpr>(*sum.right);
+  EXPECT_EQ(std::get<expr::VariableExpr>(*product.right).name.lexeme(), "x");
+
+  const auto &print = std::get<stmt::PrintStmt>(*statements[1]);
+  const auto &equal = std::get<expr::BinaryExpr>(*print.expression);
+  EXPECT_EQ(stream.source()->locate(equal.op.offset()).line, 2);
+  EXPECT_TRUE(std::holds_alternative<std::nullptr_t>(
+      std::get<expr::LiteralExpr>(*equal.right).value));
+}
+
+TEST(parserTest, testParallelParse) {
+  std::string source;
+  for (int i = 0; i < 20000; ++i) {
+    source += "var v" + std::to_string(i) + " = (" + std::to_string(i) +
+              " + v0) * -2.5 == \"s\";\nprint v" + std::to_string(i) +
+              ";\n";
+  }
+  scanner::Scanner scanner(source);
+  auto stream = scanner.scan_token_stream();
+  auto tokens = scanner::Scanner(stream.source()).scan_tokens();
+  auto serial = ast::FlatAst::build(Parser(stream).parse(), stream.source());
+
+  // 两种随机访问的模式分段解析，拼起来和串行逐个节点相同
+  auto check = [&serial, &stream](const ast::Program &program) {
+    ASSERT_EQ(program.size(), 40000u);
+    auto tree = ast::FlatAst::build(program, stream.source());
+    ASSERT_EQ(tree.size(), serial.size());
+    std::uint32_t same = 0;
+    while (same < tree.size() && tree.kind(same) == serial.kind(same) &&
+           tree.offset(same) == serial.offset(same))
+      ++same;
+    EXPECT_EQ(same, tree.size());
+  };
+  Parser parallel(stream);
+  auto program = parallel.parse_parallel(4);
+  check(program);
+  EXPECT_GT(program.arena().block_count(), 1u);
+  check(Parser(std::span<const token::Token>(tokens), stream.source())
+            .parse_parallel(4));
+
+  // 多处错误时报告源码里最靠前的那个，和串行一样
+  std::string broken = source;
+  broken.replace(broken.find("print v15000;"), 13, "print v15000 +;");
+  broken.replace(broken.find("print v100;"), 11, "print ) ;    ");
+  auto message = [](auto parse) -> std::string {
+    try {
+      parse();
+    } catch (const std::runtime_error &error) {
+      return error.what();
+    }
+    return "";
+  };
+  scanner::Scanner broken_scanner(broken);
+  auto broken_stream = broken_scanner.scan_token_stream();
+  std::string expected =
+      message([&] { Parser(broken_stream).parse(); });
+  EXPECT_NE(expected.find("line: 202"), std::string::npos) << expected;
+  for (int run = 0; run < 2; ++run)
+    EXPECT_EQ(message([&] { Parser(broken_stream).parse_parallel(4); }),
+              expected);
+}
+
+// 和对编辑后的文本完整解析得到的树逐个节点相同
+bool matches_full_parse(const Parser::Document &document) {
+  const auto &source = document.tokens.source();
+  auto incremental = ast::FlatAst::build(document.program, source);
+  auto full = ast::FlatAst::build(
+      Parser::parse_document(scanner::Scanner(source).scan_token_stream())
+          .program,
+      source);
+  if (incremental.size() != full.size())
+    return false;
+  for (std::uint32_t i = 0; i < full.size(); ++i) {
+    if (incremental.kind(i) != full.kind(i) ||
+        incremental.offset(i) != full.offset(i) ||
+        ((incremental.kind(i) == ast::FlatAst::Kind::String ||
+          incremental.kind(i) == ast::FlatAst::Kind::Text) &&
+         incremental.literal(i) != full.literal(i)))
+      return false;
+  }
+  return true;
+}
+
+TEST(parserTest, testIncrementalReparse) {
+  std::string text;
+  for (int i = 0; i < 100; ++i)
+    text += "var v" + std::to_string(i) + " = \"s\" + " + std::to_string(i) +
+            ";\n";
+  auto document =
+      Parser::parse_document(scanner::Scanner(text).scan_token_stream());
+  ASSERT_EQ(document.program.size(), 100u);
+  std::vector<stmt::Stmt *> before(document.program.begin(),
+                                   document.program.end());
+
+  {
+    // 只改第 50 条语句里的数字，其余语句还是原来的节点
+    std::size_t offset = text.find("+ 50;") + 2;
+    auto result = Parser::reparse(std::move(document), {offset, 2, "5000"});
+    document = std::move(result.document);
+    EXPECT_EQ(result.first, 50u);
+    EXPECT_EQ(result.removed, 1u);
+    EXPECT_EQ(result.inserted, 1u);
+    for (std::size_t i = 0; i < 100; ++i)
+      EXPECT_EQ(document.program[i] == before[i], i != 50) << i;
+    // 后面 49 条语句只改平移量，不碰节点
+    EXPECT_EQ(result.rebased, 0u);
+    EXPECT_EQ(document.program.shift(49), 0);
+    EXPECT_EQ(document.program.shift(50), 0);
+    EXPECT_EQ(document.program.shift(51), 2);
+    EXPECT_TRUE(matches_full_parse(document));
+  }
+
+  {
+    // 一条拆成两条
+    std::size_t offset = document.tokens.source()->view().find("var v10 ");
+    auto result =
+        Parser::reparse(std::move(document), {offset, 0, "print v9; "});
+    document = std::move(result.document);
+    EXPECT_EQ(result.first, 10u);
+    EXPECT_EQ(result.removed, 0u);
+    EXPECT_EQ(result.inserted, 1u);
+    EXPECT_EQ(document.program.size(), 101u);
+    EXPECT_EQ(document.program[11], before[10]);
+    EXPECT_TRUE(matches_full_parse(document));
+  }
+
+  {
+    // 在末尾追加（REPL 的用法）：只报告新加的语句
+    std::size_t size = document.tokens.source()->size();
+    auto result = Parser::reparse(std::move(document), {size, 0, "print 1;\n"});
+    document = std::move(result.document);
+    EXPECT_EQ(result.first, 101u);
+    EXPECT_EQ(result.removed, 0u);
+    EXPECT_EQ(result.inserted, 1u);
+    EXPECT_EQ(result.rebased, 0u);
+    EXPECT_TRUE(matches_full_parse(document));
+  }
+
+  {
+    // 语法错误时抛出，document 保持原样；原地改写过的文本也改回去
+    const std::string text(document.tokens.source()->view());
+    std::size_t offset = text.find("var v20");
+    EXPECT_THROW(Parser::reparse(std::move(document), {offset, 0, "print "}),
+                 std::runtime_error);
+    EXPECT_EQ(document.program.size(), 102u);
+    EXPECT_EQ(document.tokens.source()->view(), text);
+    EXPECT_TRUE(matches_full_parse(document));
+  }
+
+  {
+    // 反复编辑同一处，替换下来的节点攒多了会整体重新解析一次。
+    // 只有 document 拿着 source，文本一直在原地改写
+    std::size_t offset = document.tokens.source()->view().find("\"s\"");
+    const char *data = document.tokens.source()->data();
+    for (int i = 0; i < 300; ++i) {
+      auto result = Parser::reparse(std::move(document),
+                                    {offset + 1, 1, i % 2 ? "s" : "t"});
+      document = std::move(result.document);
+      ASSERT_EQ(result.removed, 1u);
+      ASSERT_EQ(document.tokens.source()->data(), data);
+    }
+    EXPECT_LE(document.garbage, document.program.size());
+    EXPECT_TRUE(matches_full_parse(document));
+  }
+}
+
+TEST(parserTest, testReparseLongDocument) {
+  std::string text;
+  for (int i = 0; i < 10000; ++i)
+    text += "var v" + std::to_string(i) + " = \"s\" + v" +
+            std::to_string(i / 2) + " * " + std::to_string(i) + ";\n";
+  auto document =
+      Parser::parse_document(scanner::Scanner(text).scan_token_stream());
+  ASSERT_EQ(document.program.size(), 10000u);
+  std::vector<stmt::Stmt *> before(document.program.begin(),
+                                   document.program.end());
+
+  // 改第一条语句：后面 9999 条都要平移，但不碰它们的节点
+  for (const std::string inserted : {"1000", "7", "42"}) {
+    std::size_t offset = document.tokens.source()->view().find(" * ") + 3;
+    std::size_t removed =
+        document.tokens.source()->view().find(';') - offset;
+    auto result = Parser::reparse(std::move(document),
+                                  {offset, removed, inserted});
+    document = std::move(result.document);
+    EXPECT_EQ(result.first, 0u);
+    EXPECT_EQ(result.inserted, 1u);
+    EXPECT_EQ(result.rebased, 0u);
+    for (std::size_t i = 1; i < 10000; ++i)
+      ASSERT_EQ(document.program[i], before[i]) << i;
+  }
+  // 第一条语句末尾的 "0" 最后成了 "42"
+  EXPECT_EQ(document.program.shift(9999), 1);
+  EXPECT_TRUE(matches_full_parse(document));
+}
+
+TEST(parserTest, testArenaTeardown) {
+  {
+    // 20 万层左结合的加法；unique_ptr 树析构时会递归同样的深度
+    std::string source = "print 0";
+    for (int i = 0; i < 200000; ++i)
+      source += " + 1";
+    source += ";";
+    scanner::Scanner scanner(source);
+    auto stream = scanner.scan_token_stream();
+    Parser parser(stream);
+    auto program = parser.parse();
+    ASSERT_EQ(program.size(), 1);
+    const auto &print = std::get<stmt::PrintStmt>(*program[0]);
+    const auto &sum = std::get<expr::BinaryExpr>(*print.expression);
+    EXPECT_EQ(std::get<std::int64_t>(std::get<expr::LiteralExpr>(*sum.right).value), 1);
+    // 40 万个节点只占几十个块
+    EXPECT_LT(program.arena().block_count(), program.arena().bytes_used() / 32768);
+  }
+
+  {
+    // 需要析构的对象在 arena 释放时析构
+    auto counter = std::make_shared<int>(0);
+    {
+      ast::AstArena arena;
+      for (int i = 0; i < 10000; ++i)
+        arena.make<std::shared_ptr<int>>(counter);
+      EXPECT_EQ(counter.use_count(), 10001);
+    }
+    EXPECT_EQ(counter.use_count(), 1);
+  }
+}
+
+TEST(parserTest, testFlatAst) {
+  {
+    scanner::Scanner scanner("var a = 1 + 2 * -x;\nprint (a) == \"s\\n\";");
+    auto stream = scanner.scan_token_stream();
+    Parser parser(stream);
+    auto program = parser.parse();
+    auto tree = ast::FlatAst::build(program, stream.source());
+    using Kind = ast::FlatAst::Kind;
+
+    // 后序：1 2 x - * + var | a () "s\n" == print
+    const std::vector<Kind> expected = {
+        Kind::Integer, Kind::Integer, Kind::Variable, Kind::Unary,
+        Kind::Binary,  Kind::Binary,  Kind::Var,      Kind::Variable,
+        Kind::Grouping, Kind::String, Kind::Binary,   Kind::Print};
+    ASSERT_EQ(tree.size(), expected.size());
+    for (std::uint32_t i = 0; i < expected.size(); ++i)
+      EXPECT_EQ(tree.kind(i), expected[i]) << i;
+    EXPECT_EQ(std::vector<std::uint32_t>(tree.statements().begin(),
+                                         tree.statements().end()),
+              (std::vector<std::uint32_t>{6, 11}));
+
+    // 1 + (2 * -x)：左子节点记在 operand 里，右子节点紧挨在前面
+    EXPECT_EQ(tree.op(5), token::TokenType::PLUS);
+    EXPECT_EQ(tree.left(5), 0u);
+    EXPECT_EQ(tree.right(5), 4u);
+    EXPECT_EQ(tree.left(4), 1u);
+    EXPECT_EQ(tree.subtree_begin(4), 1u);
+    EXPECT_EQ(tree.subtree_begin(11), 7u);
+    EXPECT_EQ(tree.symbol(6), stream.symbol(1));
+    EXPECT_TRUE(tree.has_initializer(6));
+    EXPECT_EQ(std::get<std::int64_t>(tree.literal(1)), 2);
+    EXPECT_EQ(std::get<token::StringLiteral>(tree.literal(9)).value(), "s\n");
+    EXPECT_EQ(stream.source()->locate(tree.offset(10)).line, 2);
+  }
+
+  {
+    // 深度 20 万的树也能展开，每个节点只占十来个字节
+    std::string source = "print 0";
+    for (int i = 0; i < 200000; ++i)
+      source += " + 1";
+    source += ";";
+    scanner::Scanner scanner(source);
+    auto stream = scanner.scan_token_stream();
+    Parser parser(stream);
+    auto program = parser.parse();
+    auto tree = ast::FlatAst::build(program, stream.source());
+    ASSERT_EQ(tree.size(), 400002u);
+    EXPECT_EQ(tree.subtree_begin(tree.statements()[0]), 0u);
+    EXPECT_LE(tree.memory_usage(), tree.size() * 11);
+  }
+}
+
+TEST(parserTest, testAstCache) {
+  auto source = source::make_source(
+      "var big = 10000000000;\nvar s = \"a\\tb\";\nprint big * 2.5 + s;");
+  scanner::Scanner scanner(source);
+  Parser parser(scanner);
+  auto program = parser.parse();
+  auto tree = ast::FlatAst::build(program, source);
+  const std::string path = ::testing::TempDir() + "dtoy_cache_test.dtast";
+  const std::uint64_t key = ast::AstCache::key(*source, false);
+  ASSERT_TRUE(ast::AstCache::store(path, tree, key));
+
+  {
+    // 读回来的树和原来的逐个节点相同，数组直接指向映射
+    auto loaded = ast::AstCache::load(path, source, key);
+    ASSERT_TRUE(loaded.has_value());
+    ASSERT_EQ(loaded->size(), tree.size());
+    EXPECT_EQ(loaded->memory_usage(), 2 * sizeof(symbol::SymbolId));
+    for (std::uint32_t i = 0; i < tree.size(); ++i) {
+      ASSERT_EQ(loaded->kind(i), tree.kind(i)) << i;
+      EXPECT_EQ(loaded->offset(i), tree.offset(i)) << i;
+    }
+    EXPECT_TRUE(std::ranges::equal(loaded->statements(), tree.statements()));
+    EXPECT_EQ(loaded->symbol(1), tree.symbol(1));
+    EXPECT_EQ(std::get<std::int64_t>(loaded->literal(0)), 10000000000);
+    EXPECT_EQ(std::get<token::StringLiteral>(loaded->literal(2)).value(),
+              "a\tb");
+  }
+
+  // 源码或者折叠选项变了，key 就对不上
+  EXPECT_NE(ast::AstCache::key(*source::make_source("print 1;"), false), key);
+  EXPECT_NE(ast::AstCache::key(*source, true), key);
+  EXPECT_FALSE(ast::AstCache::load(path, source, key + 1).has_value());
+  EXPECT_FALSE(
+      ast::AstCache::load(path + ".missing", source, key).has_value());
+
+  std::string bytes;
+  {
+    std::ifstream in(path, std::ios::binary);
+    bytes.assign(std::istreambuf_iterator<char>(in), {});
+  }
+  auto rewrite = [&path](const std::string &content) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << content;
+  };
+  // 截断的文件
+  rewrite(bytes.substr(0, bytes.size() - 8));
+  EXPECT_FALSE(ast::AstCache::load(path, source, key).has_value());
+  // 结构被破坏：第一个节点改成 Binary，值栈上没有操作数
+  std::string corrupted = bytes;
+  corrupted[112] = static_cast<char>(ast::FlatAst::Kind::Binary);
+  rewrite(corrupted);
+  EXPECT_FALSE(ast::AstCache::load(path, source, key).has_value());
+  // 别的版本写的文件：文件头的 version（第 8 字节起）或者构建标识
+  //（第 16 字节起）对不上，key 相同也不读
+  for (std::size_t at : {8u, 16u}) {
+    std::string other = bytes;
+    other[at] = static_cast<char>(other[at] ^ 1);
+    rewrite(other);
+    EXPECT_FALSE(ast::AstCache::load(path, source, key).has_value()) << at;
+  }
+  std::uint64_t build = 0;
+  std::memcpy(&build, bytes.data() + 16, sizeof(build));
+  EXPECT_EQ(build, ast::AstCache::build_id());
+  rewrite(bytes);
+  EXPECT_TRUE(ast::AstCache::load(path, source, key).has_value());
+  std::remove(path.c_str());
+}
+
+TEST(parserTest, testSourceSizeLimit) {
+  EXPECT_NO_THROW(token::check_source_size(token::kMaxSourceBytes));
+  EXPECT_THROW(token::check_source_size(token::kMaxSourceBytes + 1),
+               std::length_error);
+
+  // 稀疏文件，映射进来不占内存；刚好超过 4 GB 一个字节，
+  // 构造 scanner 时就被拒绝，不会先校验一遍 UTF-8
+  const std::string path = ::testing::TempDir() + "dtoy_too_large.dt";
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.seekp(static_cast<std::streamoff>(token::kMaxSourceBytes));
+    out.put(';');
+  }
+  auto source = source::SourceBuffer::open(path);
+  ASSERT_EQ(source->size(), token::kMaxSourceBytes + 1);
+  try {
+    scanner::Scanner scanner(source);
+    ADD_FAILURE() << "expected std::length_error";
+  } catch (const std::length_error &e) {
+    EXPECT_NE(std::string(e.what()).find("4294967296"), std::string::npos)
+        << e.what();
+  }
+  source.reset();
+  std::remove(path.c_str());
+}
+
 } // namespace parser
 } // namespace dtoy
 
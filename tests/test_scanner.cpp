@@ -1,5 +1,12 @@
 #include <gtest/gtest.h>
 
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
 #include "scanner.h"
 
 namespace dtoy {
@@ -9,6 +16,8 @@ public:
   void scan_token(Scanner &obj) {
     obj.scan_token();
   }
+  bool is_at_end(const Scanner &obj) const { return obj.is_at_end(); }
+  std::size_t position(const Scanner &obj) const { return obj.current_; }
 
 protected:
   Scanner scanner_1;
@@ -19,6 +28,18 @@ TEST_F(ScannerTest, show_tokens) {
   EXPECT_EQ(scanner_1.show_tokens().size(), 0);
 }
 
+TEST_F(ScannerTest, ScanTokensTakesSingleSteppedTokens) {
+  // 单步扫出来的 token 由 scan_tokens() 一起移交出去
+  scanner_1 = Scanner("a + b");
+  scan_token(scanner_1);  // a
+  ASSERT_EQ(scanner_1.show_tokens().size(), 1);
+  auto tokens = scanner_1.scan_tokens();
+  ASSERT_EQ(tokens.size(), 4);
+  EXPECT_EQ(tokens[0].lexeme(), "a");
+  EXPECT_EQ(tokens[3].type(), token::TokenType::EOF_);
+  EXPECT_TRUE(scanner_1.show_tokens().empty());
+}
+
 // Literal相关的
 TEST_F(ScannerTest, AddTokenSingleCharacter) {
   scanner_1 = Scanner("(){},.+-*/");  // 空输入
@@ -175,6 +196,34 @@ TEST_F(ScannerTest, AddTokenNumber) {
   EXPECT_EQ(scanner_1.show_tokens()[3].lexeme(), "1000");
 }
 
+TEST_F(ScannerTest, AddTokenNumberLiteralForms) {
+  Scanner scanner("0x1F 0B101 1_000_000 2.5_0 9223372036854775807 "
+                  "9223372036854775808 0x1_0000_0000_0000_0000 1_ 0x");
+  auto tokens = scanner.scan_tokens();
+  ASSERT_EQ(tokens.size(), 12);
+
+  EXPECT_EQ(tokens[0].lexeme(), "0x1F");
+  EXPECT_EQ(std::get<std::int64_t>(tokens[0].literal()), 31);
+  EXPECT_EQ(std::get<std::int64_t>(tokens[1].literal()), 5);
+  EXPECT_EQ(tokens[2].lexeme(), "1_000_000");
+  EXPECT_EQ(std::get<std::int64_t>(tokens[2].literal()), 1000000);
+  EXPECT_DOUBLE_EQ(std::get<double>(tokens[3].literal()), 2.5);
+  EXPECT_EQ(std::get<std::int64_t>(tokens[4].literal()),
+            std::numeric_limits<std::int64_t>::max());
+
+  // 超出 int64 的整数提升为 double
+  EXPECT_DOUBLE_EQ(std::get<double>(tokens[5].literal()),
+                   9223372036854775808.0);
+  EXPECT_DOUBLE_EQ(std::get<double>(tokens[6].literal()), 18446744073709551616.0);
+
+  // 结尾的 '_' 和缺少数字的 "0x" 不属于数字
+  EXPECT_EQ(tokens[7].lexeme(), "1");
+  EXPECT_EQ(tokens[8].type(), token::TokenType::IDENTIFIER);
+  EXPECT_EQ(tokens[8].lexeme(), "_");
+  EXPECT_EQ(tokens[9].lexeme(), "0");
+  EXPECT_EQ(tokens[10].lexeme(), "x");
+}
+
 
 
 
@@ -260,7 +309,7 @@ TEST_F(ScannerTest, AddTokenString){
   scan_token(scanner_1);                                       // "Hello, World!"
   EXPECT_EQ(scanner_1.show_tokens().size(), 1);
   EXPECT_EQ(scanner_1.show_tokens()[0].type(), token::TokenType::STRING);
-  EXPECT_EQ(std::get<std::string>(scanner_1.show_tokens()[0].literal()), "Hello, World!");
+  EXPECT_EQ(std::get<token::StringLiteral>(scanner_1.show_tokens()[0].literal()).value(), "Hello, World!");
   EXPECT_EQ(scanner_1.show_tokens()[0].lexeme(), "\"Hello, World!\"");
 
   // skip whitespace
@@ -269,7 +318,7 @@ TEST_F(ScannerTest, AddTokenString){
   scan_token(scanner_1);  // "Line1\nLine2"
   EXPECT_EQ(scanner_1.show_tokens().size(), 2);
   EXPECT_EQ(scanner_1.show_tokens()[1].type(), token::TokenType::STRING);
-  EXPECT_EQ(std::get<std::string>(scanner_1.show_tokens()[1].literal()), "Line1\nLine2");
+  EXPECT_EQ(std::get<token::StringLiteral>(scanner_1.show_tokens()[1].literal()).value(), "Line1\nLine2");
   EXPECT_EQ(scanner_1.show_tokens()[1].lexeme(), "\"Line1\\nLine2\"");
 
   // skip whitespace
@@ -278,12 +327,43 @@ TEST_F(ScannerTest, AddTokenString){
   scan_token(scanner_1);  // "Tab\tCharacter"
   EXPECT_EQ(scanner_1.show_tokens().size(), 3);
   EXPECT_EQ(scanner_1.show_tokens()[2].type(), token::TokenType::STRING);
-  EXPECT_EQ(std::get<std::string>(scanner_1.show_tokens()[2].literal()), "Tab\tCharacter");
+  EXPECT_EQ(std::get<token::StringLiteral>(scanner_1.show_tokens()[2].literal()).value(), "Tab\tCharacter");
   EXPECT_EQ(scanner_1.show_tokens()[2].lexeme(), "\"Tab\\tCharacter\"");
 
 }
 
 
+TEST_F(ScannerTest, StringLiteralIsLazy) {
+  scanner_1 = Scanner("\"plain text\" \"a\\tb\\\\\" \"\"");
+  auto tokens = scanner_1.scan_tokens();
+  ASSERT_EQ(tokens.size(), 4);
+
+  // 没有转义：直接指向 source，不拷贝
+  const auto &plain = std::get<token::StringLiteral>(tokens[0].literal());
+  EXPECT_FALSE(plain.escaped());
+  EXPECT_EQ(plain.raw(), "plain text");
+  EXPECT_TRUE(scanner_1.source()->contains(plain.raw()));
+
+  // 有转义：保留原文，取值时才解码
+  const auto &escaped = std::get<token::StringLiteral>(tokens[1].literal());
+  EXPECT_TRUE(escaped.escaped());
+  EXPECT_EQ(escaped.raw(), "a\\tb\\\\");
+  EXPECT_EQ(escaped.value(), "a\tb\\");
+  EXPECT_EQ(escaped, token::StringLiteral("a\tb\\", false));
+
+  EXPECT_EQ(std::get<token::StringLiteral>(tokens[2].literal()).value(), "");
+
+  // 增量重扫之后，沿用的字符串字面量指向新的 source
+  token::TokenStream stream = [] {
+    Scanner scanner("x = \"kept\";\ny = 1;");
+    auto previous = scanner.scan_token_stream();
+    return Scanner::relex(previous, {16, 1, "2"}).tokens;
+  }();
+  const auto &kept = std::get<token::StringLiteral>(stream.literal(2));
+  EXPECT_TRUE(stream.source()->contains(kept.raw()));
+  EXPECT_EQ(kept.value(), "kept");
+}
+
 TEST_F(ScannerTest, addTokenIdentifierAndKeywords){
   scanner_1 = Scanner("if else for while return var fun class true false nil");  // 空输入
 
@@ -305,5 +385,511 @@ TEST_F(ScannerTest, addTokenIdentifierAndKeywords){
 }
 
 
+TEST_F(ScannerTest, LexemeViewsIntoSource) {
+  scanner_1 = Scanner("var name = \"text\" + 'c' * 12.5;");
+  auto tokens = scanner_1.scan_tokens();
+  const auto &source = scanner_1.source();
+
+  ASSERT_FALSE(tokens.empty());
+  for (const auto &token : tokens) {
+    // lexeme 不拷贝，直接指向 SourceBuffer
+    EXPECT_TRUE(source->contains(token.lexeme())) << token.to_string();
+  }
+  EXPECT_EQ(tokens[0].lexeme(), "var");
+  EXPECT_EQ(tokens[3].lexeme(), "\"text\"");
+  EXPECT_EQ(std::get<token::StringLiteral>(tokens[3].literal()).value(), "text");
+  EXPECT_EQ(tokens[5].lexeme(), "'c'");
+  EXPECT_EQ(tokens.back().type(), token::TokenType::EOF_);
+  EXPECT_EQ(tokens.back().lexeme(), "");
+}
+
+
+TEST_F(ScannerTest, NextTokenMatchesScanTokens) {
+  const std::string source = "var a = (1 + 2.5) * \"s\\n\";\nprint a != 'x';  ";
+  Scanner reference(source);  // 保持 buffer 存活，lexeme 指向它
+  auto expected = reference.scan_tokens();
+
+  scanner_1 = Scanner(source);
+  for (const auto &want : expected) {
+    auto got = scanner_1.next_token();
+    EXPECT_EQ(got.type(), want.type());
+    EXPECT_EQ(got.lexeme(), want.lexeme());
+    EXPECT_EQ(got.literal(), want.literal());
+    EXPECT_EQ(got.offset(), want.offset());
+  }
+  // 结尾之后一直返回 EOF_，且 scanner 内部不累积 token
+  EXPECT_EQ(scanner_1.next_token().type(), token::TokenType::EOF_);
+  EXPECT_TRUE(scanner_1.show_tokens().empty());
+}
+
+
+TEST_F(ScannerTest, LineComment) {
+  scanner_1 = Scanner("1 // comment \"not a string\"\n/ 2 //");
+  auto tokens = scanner_1.scan_tokens();
+  ASSERT_EQ(tokens.size(), 4);
+  EXPECT_EQ(tokens[0].type(), token::TokenType::NUMBER);
+  EXPECT_EQ(tokens[1].type(), token::TokenType::SLASH);
+  EXPECT_EQ(scanner_1.source()->locate(tokens[1].offset()).line, 2);
+  EXPECT_EQ(tokens[2].type(), token::TokenType::NUMBER);
+  EXPECT_EQ(tokens[3].type(), token::TokenType::EOF_);
+}
+
+TEST_F(ScannerTest, LocateLineAndColumn) {
+  // 字符串里的换行也算行
+  scanner_1 = Scanner("a\n  \"x\ny\" b\n\n  c");
+  auto tokens = scanner_1.scan_tokens();
+  ASSERT_EQ(tokens.size(), 5);
+  const auto &source = *scanner_1.source();
+  EXPECT_EQ(source.newline_offsets(), (std::vector<std::size_t>{1, 6, 11, 12}));
+
+  auto locate = [&](std::size_t i) { return source.locate(tokens[i].offset()); };
+  EXPECT_EQ(locate(0).line, 1);
+  EXPECT_EQ(locate(0).column, 1);
+  EXPECT_EQ(locate(1).line, 2);
+  EXPECT_EQ(locate(1).column, 3);
+  EXPECT_EQ(locate(2).line, 3);
+  EXPECT_EQ(locate(2).column, 4);
+  EXPECT_EQ(locate(3).line, 5);
+  EXPECT_EQ(locate(3).column, 3);
+  EXPECT_EQ(locate(4).line, 5);  // EOF_
+  EXPECT_EQ(locate(4).column, 4);
+}
+
+TEST_F(ScannerTest, SimdLevelsMatchScalar) {
+  // 超过 32 字节的空白、标识符、数字和字符串体，覆盖向量循环和尾部
+  std::string source;
+  for (int i = 0; i < 40; ++i) {
+    source += std::string(i, ' ') + "\t\n";
+    source += "identifier_" + std::string(i, 'x') + std::to_string(i) + " ";
+    source += std::string(i + 1, '7') + "." + std::string(i + 1, '3') + "+";
+    source += "\"" + std::string(i, 's') + "\\t" + std::string(i, 'q') + "\"";
+    source += "// comment " + std::string(i, '/') + "\n";
+  }
+  source += "\xC3\xA9 end";  // 非 ASCII 字符属于标识符
+
+  Scanner reference(source);
+  reference.set_simd_level(simd::Level::Scalar);
+  auto expected = reference.scan_tokens();
+
+  for (simd::Level level : {simd::Level::SSE2, simd::Level::AVX2}) {
+    Scanner scanner(source);
+    scanner.set_simd_level(level);
+    auto tokens = scanner.scan_tokens();
+    ASSERT_EQ(tokens.size(), expected.size());
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+      EXPECT_EQ(tokens[i].type(), expected[i].type());
+      EXPECT_EQ(tokens[i].lexeme(), expected[i].lexeme());
+      EXPECT_EQ(tokens[i].literal(), expected[i].literal());
+      EXPECT_EQ(tokens[i].offset(), expected[i].offset());
+    }
+  }
+}
+
+
+TEST_F(ScannerTest, TableModeMatchesSwitchMode) {
+  // 本文件里用到的全部输入，外加一些回退/边界情况
+  const std::vector<std::string> corpus = {
+      "",
+      "(){},.+-*/",
+      "!= ! == = >= <=",
+      "varName anotherVar _privateVar var123",
+      "123 45.67 0.89 1000",
+      "'a' 'Z' '0' '_' '\\n'   '\\t'",
+      "\"hello\" \"world\" \"test string\"",
+      "\"Hello, World!\" \"Line1\\nLine2\" \"Tab\\tCharacter\"",
+      "if else for while return var fun class true false nil",
+      "var name = \"text\" + 'c' * 12.5;",
+      "var a = (1 + 2.5) * \"s\\n\";\nprint a != 'x';  ",
+      "1 // comment \"not a string\"\n/ 2 //",
+      "1. 2.x .5 a.b 3..4 !!= === <== >>= @# \xC3\xA9 x",
+      "trailing\n\n  ",
+      "0x1F 0b101 1_000 0x 0b2 1__0 1_ 0x_1 9223372036854775808 1_0.2_5",
+  };
+
+  for (const auto &source : corpus) {
+    Scanner by_switch(source);
+    Scanner by_table(source);
+    by_table.set_mode(Scanner::Mode::Table);
+
+    // 每次 scan_token 的粒度也必须一致
+    while (!is_at_end(by_switch)) {
+      ASSERT_FALSE(is_at_end(by_table)) << source;
+      scan_token(by_switch);
+      scan_token(by_table);
+      ASSERT_EQ(position(by_table), position(by_switch)) << source;
+    }
+    EXPECT_TRUE(is_at_end(by_table)) << source;
+
+    const auto &expected = by_switch.show_tokens();
+    const auto &tokens = by_table.show_tokens();
+    ASSERT_EQ(tokens.size(), expected.size()) << source;
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+      EXPECT_EQ(tokens[i].type(), expected[i].type()) << source;
+      EXPECT_EQ(tokens[i].lexeme(), expected[i].lexeme()) << source;
+      EXPECT_EQ(tokens[i].literal(), expected[i].literal()) << source;
+      EXPECT_EQ(tokens[i].offset(), expected[i].offset()) << source;
+    }
+  }
+
+  // 空输入直接 scan_token 得到 EOF_
+  scanner_1 = Scanner("");
+  scanner_1.set_mode(Scanner::Mode::Table);
+  scan_token(scanner_1);
+  ASSERT_EQ(scanner_1.show_tokens().size(), 1);
+  EXPECT_EQ(scanner_1.show_tokens()[0].type(), token::TokenType::EOF_);
+}
+
+
+TEST_F(ScannerTest, TokenStreamMatchesScanTokens) {
+  const std::string source =
+      "var a = 0x10 + 2.5; // note\nprint \"s\\n\" + 'c';\n\n"
+      "if (true) a = nil; else a = false;";
+  Scanner by_vector(source);
+  const auto expected = by_vector.scan_tokens();
+  Scanner by_stream(source);
+  const auto stream = by_stream.scan_token_stream();
+
+  ASSERT_EQ(stream.size(), expected.size());
+  for (std::size_t i = 0; i < stream.size(); ++i) {
+    const token::Token token = stream[i];
+    EXPECT_EQ(token.type(), expected[i].type()) << i;
+    EXPECT_EQ(token.lexeme(), expected[i].lexeme()) << i;
+    EXPECT_EQ(token.literal(), expected[i].literal()) << i;
+    EXPECT_EQ(token.offset(), expected[i].offset()) << i;
+    EXPECT_EQ(token.symbol(), expected[i].symbol()) << i;
+    EXPECT_EQ(stream.type(i), expected[i].type()) << i;
+  }
+  // 每个 token 的固定开销是 9 字节，稀疏表按需增长
+  EXPECT_LT(stream.memory_usage(), expected.size() * sizeof(token::Token));
+}
+
+TEST_F(ScannerTest, ParallelMatchesSerial) {
+  // 字符串跨行、字符串和注释里有引号、字符字面量是引号或换行，
+  // 这些位置的换行都不能作为切分点
+  std::string source;
+  for (int i = 0; source.size() < 512 * 1024; ++i) {
+    source += "var v" + std::to_string(i) + " = " + std::to_string(i) +
+              " + 0x1F * 2.5; // it's \"quoted\"\n";
+    source += "print \"multi\nline \\\" // not a comment\n\";\n";
+    source += "print '\"'; print '\\''; print '\n';\n\n";
+  }
+  // 占了一大半文本的跨行字符串：目标位置附近的换行都在字符串里，
+  // 切分点只能靠前一块发现字符串被切断之后重扫
+  const std::string prefix = source.substr(0, source.find("var v", 64 * 1024));
+  std::string long_string = prefix + "print \"";
+  for (int i = 0; long_string.size() < 400 * 1024; ++i)
+    long_string += "line " + std::to_string(i) + " // ' \\\" \n";
+  long_string += "\";\n" + prefix;
+
+  for (const std::string &text : {source, long_string}) {
+    for (Scanner::Mode mode : {Scanner::Mode::Switch, Scanner::Mode::Table}) {
+      Scanner serial(text);
+      serial.set_mode(mode);
+      const auto expected = serial.scan_tokens();
+
+      for (unsigned threads : {1u, 2u, 3u, 8u}) {
+        Scanner parallel(text);
+        parallel.set_mode(mode);
+        const auto tokens = parallel.scan_tokens_parallel(threads);
+        ASSERT_EQ(tokens.size(), expected.size()) << threads;
+        for (std::size_t i = 0; i < tokens.size(); ++i) {
+          ASSERT_EQ(tokens[i].type(), expected[i].type()) << i;
+          ASSERT_EQ(tokens[i].lexeme().data() - parallel.source()->data(),
+                    expected[i].lexeme().data() - serial.source()->data())
+              << i;
+          ASSERT_EQ(tokens[i].lexeme(), expected[i].lexeme()) << i;
+          ASSERT_EQ(tokens[i].literal(), expected[i].literal()) << i;
+          ASSERT_EQ(tokens[i].offset(), expected[i].offset()) << i;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(ScannerTest, RelexMatchesFullScan) {
+  std::string source;
+  for (int i = 0; i < 2000; ++i)
+    source += "var v" + std::to_string(i) + " = " + std::to_string(i) +
+              " + 1.5; // note\n";
+  Scanner original(source);
+  const auto previous = original.scan_token_stream();
+  const std::size_t middle = source.find("v1000");
+
+  const std::vector<Scanner::Edit> edits = {
+      {middle + 1, 0, "9"},             // 标识符变长
+      {middle, 5, "x"},                 // 替换
+      {source.find("1.5", middle), 1, "27"},  // 数字跨过小数点
+      {source.find("//", middle), 2, "/"},    // 注释变成除号
+      {0, 3, ""},                       // 开头删除
+      {source.size(), 0, "print 1;"},   // 结尾追加
+      {middle, 0, "\""},                // 未闭合字符串吞掉后面所有内容
+  };
+  for (const auto &edit : edits) {
+    std::string text = source;
+    text.replace(edit.offset, edit.removed, edit.inserted);
+    Scanner full(text);
+    const auto expected = full.scan_token_stream();
+
+    auto result = Scanner::relex(previous, edit);
+    const auto &tokens = result.tokens;
+    ASSERT_EQ(tokens.source()->view(), text) << edit.inserted;
+    ASSERT_EQ(tokens.size(), expected.size()) << edit.inserted;
+    for (std::size_t i = 0; i < tokens.size(); ++i) {
+      ASSERT_EQ(tokens.type(i), expected.type(i)) << i;
+      ASSERT_EQ(tokens.offset(i), expected.offset(i)) << i;
+      ASSERT_EQ(tokens.lexeme(i), expected.lexeme(i)) << i;
+      ASSERT_EQ(tokens.literal(i), expected.literal(i)) << i;
+      ASSERT_EQ(tokens.symbol(i), expected.symbol(i)) << i;
+    }
+    // 单字符编辑只重扫编辑点附近的几个 token
+    if (edit.inserted != "\"") {
+      EXPECT_LE(result.relexed, 12) << edit.inserted;
+    }
+  }
+}
+
+TEST_F(ScannerTest, RelexSharesUnchangedTokensAndText) {
+  std::string source;
+  for (int i = 0; i < 2000; ++i)
+    source += "var v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+  Scanner original(source);
+  const auto previous = original.scan_token_stream();
+  ASSERT_GT(previous.size(), 2 * token::TokenStream::kChunkTokens);
+
+  // 中间编辑：前后缀共享旧 chunk，只多出编辑点两侧的切片
+  auto edited = Scanner::relex(previous, {source.find("v1000"), 0, "w"});
+  EXPECT_LE(edited.tokens.piece_count(), previous.piece_count() + 3);
+  EXPECT_EQ(edited.tokens.lexeme(edited.tokens.size() - 3), "1999");
+
+  // 结尾追加：第一次分配可增长缓冲，之后原地写入
+  auto first = Scanner::relex(previous, {source.size(), 0, "print 1;\n"});
+  const char *data = first.tokens.source()->data();
+  auto second = Scanner::relex(
+      first.tokens, {first.tokens.source()->size(), 0, "print 2;\n"});
+  EXPECT_EQ(second.tokens.source()->data(), data);
+  EXPECT_EQ(first.tokens.source()->view(), source + "print 1;\n");
+  EXPECT_EQ(second.tokens.source()->view(), source + "print 1;\nprint 2;\n");
+  EXPECT_EQ(second.tokens.lexeme(second.tokens.size() - 3), "2");
+  EXPECT_LE(second.relexed, 6);
+}
+
+TEST_F(ScannerTest, CursorMatchesRandomAccess) {
+  std::string source;
+  for (int i = 0; i < 3000; ++i)
+    source += "var v" + std::to_string(i) + " = \"s\" + " +
+              std::to_string(i) + ";\n";
+  Scanner original(source);
+  auto stream = original.scan_token_stream();
+  // 几处编辑之后 stream 是好几段拼起来的，随机读取要二分查找
+  for (int i : {2500, 1200, 100}) {
+    std::size_t offset = source.find("v" + std::to_string(i) + " ");
+    stream = Scanner::relex(stream, {offset, 0, "w"}).tokens;
+    source.insert(offset, "w");
+  }
+  ASSERT_GT(stream.piece_count(), 6u);
+
+  token::TokenStream::Cursor cursor(stream);
+  auto same = [&](std::size_t i) {
+    const token::Token token = stream.at(i);
+    const token::Token read = cursor.at(i);
+    return cursor.type(i) == stream.type(i) &&
+           cursor.offset(i) == stream.offset(i) &&
+           cursor.length(i) == stream.length(i) &&
+           cursor.lexeme(i) == stream.lexeme(i) &&
+           cursor.literal(i) == stream.literal(i) &&
+           cursor.symbol(i) == stream.symbol(i) &&
+           read.lexeme() == token.lexeme() && read.offset() == token.offset();
+  };
+  // 顺序向前、向后和随机跳转都和按下标读取相同
+  for (std::size_t i = 0; i < stream.size(); ++i)
+    ASSERT_TRUE(same(i)) << i;
+  for (std::size_t i = stream.size(); i-- > 0;)
+    ASSERT_TRUE(same(i)) << i;
+  std::mt19937 random(7);
+  for (int n = 0; n < 1000; ++n)
+    ASSERT_TRUE(same(random() % stream.size()));
+}
+
+TEST_F(ScannerTest, RewriteInPlace) {
+  const std::string text = "print 1;\nprint 2;\nprint 3;\n";
+  auto owned = source::make_source(text);
+  {
+    // 自己持有的 std::string 没有余量，拷贝一份，原来的不变
+    source::SourceBuffer::Rewrite rewrite(owned, 6, 1, "10");
+    EXPECT_FALSE(rewrite.in_place());
+    EXPECT_EQ(rewrite.result()->view(), "print 10;\nprint 2;\nprint 3;\n");
+    rewrite.commit();
+  }
+  EXPECT_EQ(owned->view(), text);
+
+  // splice() 得到的 buffer 留了余量
+  auto growable = source::SourceBuffer::splice(owned, text.size(), 0, "");
+  const char *data = growable->data();
+  {
+    // 别人还拿着这个 buffer 时不能改写
+    auto other = growable;
+    source::SourceBuffer::Rewrite rewrite(growable, 6, 1, "10");
+    EXPECT_FALSE(rewrite.in_place());
+    EXPECT_NE(rewrite.result()->data(), data);
+  }
+  EXPECT_EQ(growable->view(), text);
+  {
+    // 没有 commit()：原地改写，析构时改回去
+    source::SourceBuffer::Rewrite rewrite(growable, 15, 1, "200");
+    ASSERT_TRUE(rewrite.in_place());
+    EXPECT_EQ(rewrite.result()->data(), data);
+    EXPECT_EQ(rewrite.result()->view(), "print 1;\nprint 200;\nprint 3;\n");
+  }
+  EXPECT_EQ(growable->view(), text);
+  {
+    source::SourceBuffer::Rewrite rewrite(growable, 9, 9, "");
+    ASSERT_TRUE(rewrite.in_place());
+    EXPECT_EQ(rewrite.result()->view(), "print 1;\nprint 3;\n");
+  }
+  EXPECT_EQ(growable->view(), text);
+
+  std::shared_ptr<const source::SourceBuffer> edited;
+  {
+    source::SourceBuffer::Rewrite rewrite(growable, 15, 1, "200");
+    rewrite.commit();
+    edited = rewrite.result();
+  }
+  growable.reset();
+  EXPECT_EQ(edited->data(), data);
+  EXPECT_EQ(edited->view(), "print 1;\nprint 200;\nprint 3;\n");
+  EXPECT_THROW(source::SourceBuffer::Rewrite(edited, 40, 0, "x"),
+               std::out_of_range);
+}
+
+TEST_F(ScannerTest, Utf8IdentifiersAndStrings) {
+  scanner_1 = Scanner("var 名字 = \"你好，世界\"; café_2 == x\xC3\xA9");
+  auto tokens = scanner_1.scan_tokens();
+  ASSERT_EQ(tokens.size(), 9);
+  EXPECT_EQ(tokens[1].type(), token::TokenType::IDENTIFIER);
+  EXPECT_EQ(tokens[1].lexeme(), "名字");
+  EXPECT_EQ(std::get<token::StringLiteral>(tokens[3].literal()).value(),
+            "你好，世界");
+  EXPECT_EQ(tokens[5].lexeme(), "café_2");
+  EXPECT_EQ(tokens[7].lexeme(), "x\xC3\xA9");
+  // 列号按字符计
+  EXPECT_EQ(scanner_1.source()->locate(tokens[2].offset()).column, 8);
+
+  Scanner by_table("var 名字 = \"你好\";");
+  by_table.set_mode(Scanner::Mode::Table);
+  EXPECT_EQ(by_table.scan_tokens()[1].lexeme(), "名字");
+}
+
+TEST_F(ScannerTest, InvalidUtf8) {
+  const std::vector<std::string> invalid = {
+      "\x80",                  // 孤立的后续字节
+      "\xC3",                  // 截断
+      "\xC0\xAF",              // 过长编码
+      "\xE0\x80\xAF",          // 过长编码
+      "\xED\xA0\x80",          // 代理区
+      "\xF4\x90\x80\x80",      // 超过 U+10FFFF
+      "\xF8\x88\x80\x80\x80",  // 五字节
+      "\xE4\xBD",              // 截断的三字节字符
+  };
+  const std::string padding(40, 'a');
+  for (const auto &bytes : invalid) {
+    std::string source = padding + "\xE4\xBD\xA0" + padding + bytes + padding;
+    std::size_t expected = 2 * padding.size() + 3;
+    for (simd::Level level :
+         {simd::Level::Scalar, simd::Level::SSE2, simd::Level::AVX2}) {
+      const auto &kernels = simd::kernels(level);
+      const char *begin = source.data();
+      EXPECT_EQ(kernels.validate_utf8(begin, begin + source.size()) - begin,
+                expected)
+          << simd::level_name(level);
+    }
+    EXPECT_THROW(Scanner{source}, std::runtime_error);
+  }
+
+  // 增量重扫也会拒绝插入的非法字节，包括把多字节字符截断的删除
+  Scanner valid("x = \"你\";");
+  auto stream = valid.scan_token_stream();
+  EXPECT_THROW(Scanner::relex(stream, {2, 0, "\xFF"}), std::runtime_error);
+  EXPECT_THROW(Scanner::relex(stream, {5, 1, ""}), std::runtime_error);
+  EXPECT_NO_THROW(Scanner::relex(stream, {5, 3, "好"}));
+}
+
+TEST(Simd, Utf8KernelsMatchScalar) {
+  const auto &scalar = simd::kernels(simd::Level::Scalar);
+  auto check = [&scalar](const std::string &text) {
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    const char *expected = scalar.validate_utf8(begin, end);
+    for (simd::Level level : {simd::Level::SSE2, simd::Level::AVX2}) {
+      const char *result = simd::kernels(level).validate_utf8(begin, end);
+      ASSERT_EQ(result - begin, expected - begin)
+          << simd::level_name(level) << " " << testing::PrintToString(text);
+    }
+  };
+
+  // 所有两字节组合，分别放在 16 / 32 字节块的边界上
+  for (std::size_t before : {14, 15, 30, 31}) {
+    for (int a = 0x80; a < 0x100; ++a) {
+      for (int b = 0; b < 0x100; ++b) {
+        std::string text(before, 'a');
+        text += static_cast<char>(a);
+        text += static_cast<char>(b);
+        text += std::string(40, 'b');
+        check(text);
+      }
+    }
+  }
+
+  // 合法字符、边界码点和非法字节随机拼接
+  const std::vector<std::string> pieces = {
+      "a", " ", "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xED\x9F\xBF",
+      "\xEE\x80\x80", "\xEF\xBF\xBF", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF",
+      "你", "é", "\x80", "\xBF", "\xC0", "\xC1", "\xE0\x9F", "\xED\xA0",
+      "\xF0\x8F", "\xF4\x90", "\xF5", "\xFF", "\xE4", "\xF0\x90"};
+  std::mt19937 random(42);
+  for (int round = 0; round < 20000; ++round) {
+    std::string text;
+    std::size_t count = random() % 40;
+    for (std::size_t i = 0; i < count; ++i) {
+      // 大多数是合法的片段，非法字节偶尔出现
+      std::size_t index = random() % pieces.size();
+      if (index >= 12 && random() % 4 != 0)
+        index = random() % 12;
+      text += pieces[index];
+    }
+    check(text);
+  }
+}
+
+TEST_F(ScannerTest, OpenFile) {
+  const std::string text = "var 名字 = 0x10;\nprint \"s\\n\" + 名字;\n";
+  const std::string path = ::testing::TempDir() + "dtoy_open_file.dt";
+  std::ofstream(path, std::ios::binary) << text;
+
+  auto source = source::SourceBuffer::open(path);
+  EXPECT_TRUE(source->mapped());
+  EXPECT_EQ(source->view(), text);
+  // 直接扫描映射和扫描同样内容的字符串结果相同
+  Scanner mapped(source);
+  Scanner copied(text);
+  auto expected = copied.scan_tokens();
+  auto tokens = mapped.scan_tokens();
+  ASSERT_EQ(tokens.size(), expected.size());
+  for (std::size_t i = 0; i < tokens.size(); ++i) {
+    EXPECT_EQ(tokens[i].lexeme(), expected[i].lexeme());
+    EXPECT_EQ(tokens[i].offset(), expected[i].offset());
+    EXPECT_EQ(tokens[i].literal(), expected[i].literal());
+  }
+  EXPECT_EQ(source->locate(tokens[5].offset()).line, 2);
+
+  // 空文件不能映射，走读取
+  std::ofstream(path, std::ios::binary | std::ios::trunc);
+  auto empty = source::SourceBuffer::open(path);
+  EXPECT_FALSE(empty->mapped());
+  EXPECT_EQ(empty->size(), 0u);
+  std::remove(path.c_str());
+
+  EXPECT_THROW(source::SourceBuffer::open(path), std::runtime_error);
+}
+
 }  // namespace scanner
 }  // namespace dtoy
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include "token.h"
 #include <gtest/gtest.h>
+#include <limits>
+#include <stdexcept>
 
 using namespace dtoy;
 
@@ -16,7 +18,7 @@ TEST(Init, Initdentifier) {
   EXPECT_EQ(token1.type(), dtoy::token::TokenType::IDENTIFIER);
   EXPECT_EQ(token1.lexeme(), "varName");
   EXPECT_EQ(std::get<std::monostate>(token1.literal()), std::monostate{});
-  EXPECT_EQ(token1.line(), 1);
+  EXPECT_EQ(token1.offset(), 1);
 }
 
 // 有literal
@@ -24,6 +26,69 @@ TEST(Init, InitNumber) {
   dtoy::token::Token token2(dtoy::token::TokenType::NUMBER, "123", 123, 2);
   EXPECT_EQ(token2.type(), dtoy::token::TokenType::NUMBER);
   EXPECT_EQ(token2.lexeme(), "123");
-  EXPECT_EQ(std::get<int>(token2.literal()), 123);
-  EXPECT_EQ(token2.line(), 2);
+  EXPECT_EQ(std::get<std::int64_t>(token2.literal()), 123);
+  EXPECT_EQ(token2.offset(), 2);
+}
+
+
+TEST(Symbol, Intern) {
+  symbol::SymbolTable table;
+  symbol::SymbolId a = table.intern("alpha");
+  symbol::SymbolId b = table.intern("beta");
+  EXPECT_NE(a, b);
+  EXPECT_EQ(table.intern(std::string("alpha")), a);
+  EXPECT_EQ(table.find("beta"), b);
+  EXPECT_EQ(table.find("gamma"), symbol::kNoSymbol);
+  EXPECT_EQ(table.name(a), "alpha");
+  EXPECT_EQ(table.size(), 2);
+
+  token::Token plain(token::TokenType::IDENTIFIER, "alpha", 1);
+  EXPECT_EQ(plain.symbol(), symbol::kNoSymbol);
+  auto ident = token::Token::identifier("alpha", a, 1);
+  EXPECT_EQ(ident.type(), token::TokenType::IDENTIFIER);
+  EXPECT_EQ(ident.symbol(), a);
+}
+
+TEST(Keyword, PerfectHash) {
+  const std::pair<const char *, token::TokenType> keywords[] = {
+      {"and", token::TokenType::AND},       {"class", token::TokenType::CLASS},
+      {"else", token::TokenType::ELSE},     {"false", token::TokenType::FALSE},
+      {"fun", token::TokenType::FUN},       {"for", token::TokenType::FOR},
+      {"if", token::TokenType::IF},         {"nil", token::TokenType::NIL},
+      {"or", token::TokenType::OR},         {"print", token::TokenType::PRINT},
+      {"return", token::TokenType::RETURN}, {"super", token::TokenType::SUPER},
+      {"this", token::TokenType::THIS},     {"true", token::TokenType::TRUE},
+      {"var", token::TokenType::VAR},       {"while", token::TokenType::WHILE},
+  };
+  for (const auto &[text, type] : keywords) {
+    auto [is_keyword, result] = token::Token::isKeyword(text);
+    EXPECT_TRUE(is_keyword) << text;
+    EXPECT_EQ(result, type) << text;
+  }
+
+  // 哈希槽位相同但文本不同的都不是关键字
+  for (const char *text : {"", "a", "an", "ands", "vat", "whilst", "Print",
+                           "returns", "t", "_if", "classy"}) {
+    auto [is_keyword, result] = token::Token::isKeyword(text);
+    EXPECT_FALSE(is_keyword) << text;
+    EXPECT_EQ(result, token::TokenType::IDENTIFIER) << text;
+  }
+}
+
+TEST(Init, TypeName) {
+  EXPECT_EQ(token::Token(token::TokenType::LEFT_PAREN, "(", 1).type_name(),
+            "LEFT_PAREN");
+  EXPECT_EQ(token::Token(token::TokenType::WHILE, "while", 1).type_name(),
+            "WHILE");
+  EXPECT_EQ(token::Token(token::TokenType::EOF_, "", 1).type_name(), "EOF_");
+}
+
+TEST(Node, OffsetLimit) {
+  // 节点只存 32 位的位置，正好 4 GB - 1 还放得下，再大就抛出
+  const std::size_t max = std::numeric_limits<std::uint32_t>::max();
+  EXPECT_EQ(token::Operator(token::TokenType::PLUS, max).offset(), max);
+  EXPECT_EQ(token::Name(symbol::kNoSymbol, max).offset(), max);
+  EXPECT_THROW(token::Operator(token::TokenType::PLUS, max + 1),
+               std::length_error);
+  EXPECT_THROW(token::Name(symbol::kNoSymbol, max + 1), std::length_error);
 }